@@ -0,0 +1,84 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include <functional>
+#include <boost/any.hpp>
+#include <Wt/WItemDelegate>
+#include <Wt/WComboBox>
+#include <Wt/WContainerWidget>
+#include <Wt/WAbstractItemModel>
+#include <Wt/WModelIndex>
+
+// Edits a cell of a view by picking one of the records offered for it. Model gets id of the picked record(as long long, EditRole).
+class ComboBoxDelegate : public Wt::WItemDelegate {
+   public:
+    using IdType = long long;
+    using Options = std::vector<std::pair<IdType, Wt::WString>>;
+
+    explicit ComboBoxDelegate(std::function<Options(const Wt::WModelIndex&)> options, Wt::WObject* parent = nullptr)
+        : Wt::WItemDelegate(parent), options(std::move(options)) {}
+
+    void setModelData(const boost::any& editState, Wt::WAbstractItemModel* model, const Wt::WModelIndex& index) const override {
+        if (!editState.empty()) {
+            model->setData(index, editState, Wt::EditRole);
+        }
+    }
+
+    boost::any editState(Wt::WWidget* editor) const override {
+        auto comboBox = comboBoxOf(editor);
+        auto current = comboBox->currentIndex();
+        if (current < 0 || current >= static_cast<int>(comboBox->ids.size())) {
+            return boost::any();
+        }
+
+        return boost::any(comboBox->ids[current]);
+    }
+
+    void setEditState(Wt::WWidget* editor, const boost::any& value) const override {
+        if (value.empty()) {
+            return;
+        }
+
+        auto comboBox = comboBoxOf(editor);
+        auto id = boost::any_cast<IdType>(value);
+        for (auto i = 0u; i < comboBox->ids.size(); i++) {
+            if (comboBox->ids[i] == id) {
+                comboBox->setCurrentIndex(static_cast<int>(i));
+            }
+        }
+    }
+
+   protected:
+    Wt::WWidget* createEditor(const Wt::WModelIndex& index, Wt::WFlags<Wt::ViewItemRenderFlag> flags) const override {
+        auto editor = new Wt::WContainerWidget;
+        auto comboBox = new IdComboBox(editor);
+        for (const auto& option : options(index)) {
+            comboBox->addItem(option.second);
+            comboBox->ids.push_back(option.first);
+        }
+
+        // options don't know which one is current, but the cell shows its name
+        comboBox->setCurrentIndex(comboBox->findText(Wt::asString(index.data(Wt::DisplayRole))));
+
+        comboBox->activated().connect(std::bind([this, editor] { closeEditor().emit(editor, true); }));
+        comboBox->escapePressed().connect(std::bind([this, editor] { closeEditor().emit(editor, false); }));
+
+        if (flags & Wt::RenderFocused) {
+            comboBox->setFocus();
+        }
+
+        return editor;
+    }
+
+   private:
+    struct IdComboBox : public Wt::WComboBox {
+        explicit IdComboBox(Wt::WContainerWidget* parent) : Wt::WComboBox(parent) {}
+        std::vector<IdType> ids;
+    };
+
+    static IdComboBox* comboBoxOf(Wt::WWidget* editor) {
+        return static_cast<IdComboBox*>(static_cast<Wt::WContainerWidget*>(editor)->widget(0));
+    }
+
+    std::function<Options(const Wt::WModelIndex&)> options;
+};
@@ -0,0 +1,245 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <functional>
+#include <condition_variable>
+#include <Wt/WServer>
+#include <Wt/WLogger>
+#include <Wt/Dbo/Exception>
+#include <Wt/Dbo/SqlConnection>
+#include <Wt/Dbo/SqlConnectionPool>
+#include <Wt/Dbo/backend/MySQL>
+#include <Wt/Dbo/backend/Sqlite3>
+#include <Wt/Dbo/backend/Postgres>
+#include "SqlDialect.h"
+#include "SqlMetrics.h"
+
+// Connection settings, read from <properties> of wt_config.xml. Defaults are what used to be hardcoded.
+struct DatabaseConfig {
+    SqlDialect dialect;  // backend, db-backend is one of mysql, sqlite, postgres
+    std::string path = "cukiernia.db";  // database file of SQLite, ":memory:" for a temporary one(e.g. benchmarks)
+    std::string name = "cukiernia";
+    std::string user = "root";
+    std::string password = "root";
+    std::string host = "localhost";
+    int port = 3306;  // default of the backend if not set
+    int poolSize = 10;
+    std::chrono::milliseconds poolTimeout = std::chrono::seconds(10);  // how long session may wait for a free connection
+    std::chrono::milliseconds slowWait = std::chrono::milliseconds(100);  // waits longer than that are logged
+    std::chrono::milliseconds slowTransaction = std::chrono::milliseconds(500);  // transactions longer than that are logged with their statements
+
+    static DatabaseConfig fromServer(const Wt::WServer& server) {
+        auto config = DatabaseConfig{};
+        auto backend = config.dialect.name();
+        readProperty(server, "db-backend", backend);
+        auto dialect = SqlDialect::fromName(backend);
+        if (!dialect) {
+            throw std::invalid_argument("DatabaseConfig: unknown db-backend \"" + backend + "\", expected mysql, sqlite or postgres");
+        }
+        config.dialect = *dialect;
+        config.port = config.dialect.defaultPort();
+
+        readProperty(server, "db-path", config.path);
+        readProperty(server, "db-name", config.name);
+        readProperty(server, "db-user", config.user);
+        readProperty(server, "db-password", config.password);
+        readProperty(server, "db-host", config.host);
+        readProperty(server, "db-port", config.port);
+        readProperty(server, "db-pool-size", config.poolSize);
+
+        auto timeout = static_cast<int>(config.poolTimeout.count());
+        readProperty(server, "db-pool-timeout-ms", timeout);
+        config.poolTimeout = std::chrono::milliseconds(timeout);
+
+        auto slowWait = static_cast<int>(config.slowWait.count());
+        readProperty(server, "db-pool-slow-wait-ms", slowWait);
+        config.slowWait = std::chrono::milliseconds(slowWait);
+
+        auto slowTransaction = static_cast<int>(config.slowTransaction.count());
+        readProperty(server, "db-slow-transaction-ms", slowTransaction);
+        config.slowTransaction = std::chrono::milliseconds(slowTransaction);
+
+        return config;
+    }
+
+   private:
+    static void readProperty(const Wt::WServer& server, const std::string& name, std::string& value) {
+        server.readConfigurationProperty(name, value);
+    }
+
+    static void readProperty(const Wt::WServer& server, const std::string& name, int& value) {
+        auto text = std::string{};
+        if (!server.readConfigurationProperty(name, text)) {
+            return;
+        }
+
+        try {
+            value = std::stoi(text);
+        } catch (const std::exception&) {
+            Wt::log("error") << "DatabaseConfig: property " << name << " is not a number(\"" << text << "\"), using " << value;
+        }
+    }
+};
+
+// Server-wide pool of connections shared by all sessions, Database borrows a connection for every transaction.
+// Works like Wt::Dbo::FixedSqlConnectionPool, but gives up after a timeout and logs long waits and saturation.
+// Connections are wrapped in SqlMetrics::Connection, so every statement is measured.
+class ConnectionPool : public Wt::Dbo::SqlConnectionPool {
+   public:
+    struct Usage {
+        int size;
+        int inUse;
+        int waiting;  // sessions waiting for a free connection
+    };
+
+    // setup runs once for every connection(e.g. settings which SQLite keeps per connection)
+    ConnectionPool(std::unique_ptr<Wt::Dbo::SqlConnection> backendConnection, const DatabaseConfig& config,
+                   const std::function<void(Wt::Dbo::SqlConnection&)>& setup = nullptr)
+        : sqlDialect(config.dialect), size(std::max(config.poolSize, 1)), timeout(config.poolTimeout), slowWait(config.slowWait) {
+        auto connection = std::make_unique<SqlMetrics::Connection>(std::move(backendConnection), config.slowTransaction);
+        for (auto i = 1; i < size; i++) {
+            connections.emplace_back(connection->clone());
+        }
+        connections.push_back(std::move(connection));
+
+        for (auto& pooled : connections) {
+            if (setup)
+                setup(*pooled);
+            freeConnections.push_back(pooled.get());
+        }
+    }
+
+    // connects to the backend chosen in config
+    static std::unique_ptr<ConnectionPool> create(const DatabaseConfig& config) {
+        switch (config.dialect.backend()) {
+            case SqlDialect::Backend::MySQL:
+                return mysql(config);
+            case SqlDialect::Backend::SQLite:
+                return sqlite(config);
+            case SqlDialect::Backend::Postgres:
+                return postgres(config);
+        }
+
+        throw std::invalid_argument("ConnectionPool: unsupported backend");
+    }
+
+    static std::unique_ptr<ConnectionPool> mysql(const DatabaseConfig& config) {
+        auto connection = std::make_unique<Wt::Dbo::backend::MySQL>(config.name, config.user, config.password, config.host, config.port);
+        Wt::log("notice") << "ConnectionPool: " << config.poolSize << " connections to mysql " << config.user << "@" << config.host << ":" << config.port << "/" << config.name;
+        return std::make_unique<ConnectionPool>(std::move(connection), config);
+    }
+
+    // every connection to ":memory:" is a separate database, so it gets only one
+    static std::unique_ptr<ConnectionPool> sqlite(DatabaseConfig config) {
+        if (config.path == ":memory:" && config.poolSize != 1) {
+            Wt::log("warning") << "ConnectionPool: in-memory SQLite database can't be shared by " << config.poolSize << " connections, using one";
+            config.poolSize = 1;
+        }
+
+        auto connection = std::make_unique<Wt::Dbo::backend::Sqlite3>(config.path);
+        Wt::log("notice") << "ConnectionPool: " << config.poolSize << " connections to sqlite " << config.path;
+
+        // SQLite locks the whole file for writes, so writers wait for each other instead of failing at once
+        auto busyTimeout = "pragma busy_timeout = " + std::to_string(config.poolTimeout.count());
+        return std::make_unique<ConnectionPool>(std::move(connection), config, [busyTimeout](Wt::Dbo::SqlConnection& pooled) { pooled.executeSql(busyTimeout); });
+    }
+
+    static std::unique_ptr<ConnectionPool> postgres(const DatabaseConfig& config) {
+        auto connectionInfo = parameter("host", config.host) + " " + parameter("port", std::to_string(config.port)) + " " + parameter("dbname", config.name) +
+                              " " + parameter("user", config.user) + " " + parameter("password", config.password);
+        auto connection = std::make_unique<Wt::Dbo::backend::Postgres>(connectionInfo);
+        Wt::log("notice") << "ConnectionPool: " << config.poolSize << " connections to postgres " << config.user << "@" << config.host << ":" << config.port << "/" << config.name;
+        return std::make_unique<ConnectionPool>(std::move(connection), config);
+    }
+
+    Usage usage() const {
+        std::lock_guard<std::mutex> lock{mutex};
+        return Usage{size, size - static_cast<int>(freeConnections.size()), waiting};
+    }
+
+    // raw SQL which differs between backends goes through it
+    const SqlDialect& dialect() const {
+        return sqlDialect;
+    }
+
+    Wt::Dbo::SqlConnection* getConnection() override {
+        auto start = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock{mutex};
+
+        if (freeConnections.empty()) {
+            waiting++;
+            if (!saturated) {
+                saturated = true;
+                Wt::log("warning") << "ConnectionPool: saturated, all " << size << " connections are in use";
+            }
+
+            auto available = freeConnectionAvailable.wait_for(lock, timeout, [this] { return !freeConnections.empty(); });
+            waiting--;
+            if (!available) {
+                Wt::log("error") << "ConnectionPool: no connection became free in " << timeout.count() << "ms, " << waiting << " more sessions are waiting";
+                throw Wt::Dbo::Exception("ConnectionPool: timed out while waiting for a free connection");
+            }
+        }
+
+        auto connection = freeConnections.back();
+        freeConnections.pop_back();
+
+        auto waitTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        if (waitTime >= slowWait) {
+            Wt::log("warning") << "ConnectionPool: waited " << waitTime.count() << "ms for a connection, " << size - static_cast<int>(freeConnections.size()) << "/" << size << " in use";
+        }
+
+        return connection;
+    }
+
+    void returnConnection(Wt::Dbo::SqlConnection* connection) override {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            freeConnections.push_back(connection);
+
+            if (saturated && waiting == 0) {
+                saturated = false;
+                Wt::log("notice") << "ConnectionPool: no longer saturated";
+            }
+        }
+
+        freeConnectionAvailable.notify_one();
+    }
+
+    void prepareForDropTables() const override {
+        std::lock_guard<std::mutex> lock{mutex};
+        for (auto* connection : freeConnections) {
+            connection->prepareForDropTables();
+        }
+    }
+
+   private:
+    // keyword=value of a libpq connection string, quoted so that values may contain spaces and quotes
+    static std::string parameter(const std::string& keyword, const std::string& value) {
+        auto quoted = std::string{};
+        for (auto c : value) {
+            if (c == '\'' || c == '\\')
+                quoted += '\\';
+            quoted += c;
+        }
+
+        return keyword + "='" + quoted + "'";
+    }
+
+    const SqlDialect sqlDialect;
+    const int size;
+    const std::chrono::milliseconds timeout;
+    const std::chrono::milliseconds slowWait;
+
+    mutable std::mutex mutex;
+    std::condition_variable freeConnectionAvailable;
+    std::vector<std::unique_ptr<Wt::Dbo::SqlConnection>> connections;
+    std::vector<Wt::Dbo::SqlConnection*> freeConnections;
+    int waiting = 0;
+    bool saturated = false;
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+// Firm and access level of the user logged into the session, resolved once per login instead of for every row or check.
+struct CurrentUser {
+    bool loggedIn = false;
+    int firmID = -1;
+    int accessLevel = 0;
+
+    // whether records of the firm may be added, edited and deleted
+    bool canEdit() const {
+        return loggedIn && accessLevel != 0;
+    }
+};
@@ -0,0 +1,156 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <Wt/Dbo/Dbo>
+#include <Wt/Dbo/WtSqlTraits>
+#include "database.h"
+#include "Unit.h"
+#include "Ingredient.h"
+#include "UnitConversions.h"
+#include "Tracing.h"
+
+// Server-wide, read-only copies of units and ingredients of every firm, shared by all sessions instead of loading them into each Dbo session.
+// Snapshots are immutable: a change makes a patched copy and swaps it in, so a session keeps a consistent snapshot as long as it holds the pointer.
+// Like RecipeSearchIndex it assumes all sessions live in one server process, and writers have to report their changes after commit.
+class FirmCatalog {
+   public:
+    using UnitID = Wt::Dbo::dbo_traits<Unit>::IdType;
+    using IngredientID = Wt::Dbo::dbo_traits<Ingredient>::IdType;
+
+    struct Snapshot {
+        std::uint64_t version = 0;  // grows with every change of the firm's catalog
+        std::map<UnitID, Unit> units;  // ordered by id, same as plain queries of the tables
+        std::map<IngredientID, Ingredient> ingredients;
+        UnitConversions conversions;
+
+        // nullptr if the firm has no such unit
+        const Unit* unit(UnitID id) const {
+            auto found = units.find(id);
+            return found != units.end() ? &found->second : nullptr;
+        }
+
+        const Ingredient* ingredient(IngredientID id) const {
+            auto found = ingredients.find(id);
+            return found != ingredients.end() ? &found->second : nullptr;
+        }
+    };
+
+    using SnapshotPtr = std::shared_ptr<const Snapshot>;
+
+    static FirmCatalog& instance() {
+        static FirmCatalog catalog;
+        return catalog;
+    }
+
+    // current snapshot of the firm, loaded with two queries if no session has asked for it yet
+    SnapshotPtr snapshot(Database& db, int firmID) {
+        auto version = std::uint64_t{0};
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            auto& firm = firms[firmID];
+            if (firm.current)
+                return firm.current;
+
+            version = firm.version;
+        }
+
+        // queries run without the lock, other firms can be read meanwhile
+        Tracing::Span span{"FirmCatalog::load"};
+        auto loaded = std::make_shared<Snapshot>();
+        loaded->version = version;
+        {
+            Wt::Dbo::Transaction transaction{db};
+            Wt::Dbo::collection<Wt::Dbo::ptr<Unit>> units = db.find<Unit>().where("owner_id = ?").bind(firmID);
+            for (const auto& unit : units) {
+                loaded->units.emplace(unit.id(), *unit);
+            }
+
+            Wt::Dbo::collection<Wt::Dbo::ptr<Ingredient>> ingredients = db.find<Ingredient>().where("owner_id = ?").bind(firmID);
+            for (const auto& ingredient : ingredients) {
+                loaded->ingredients.emplace(ingredient.id(), *ingredient);
+            }
+        }
+        rebuildConversions(*loaded);
+
+        std::lock_guard<std::mutex> lock{mutex};
+        auto& firm = firms[firmID];
+        if (firm.current)
+            return firm.current;  // another session was faster
+
+        // a change committed while loading may or may not be in the result, so it's used only by this call
+        if (firm.version == version)
+            firm.current = loaded;
+
+        return loaded;
+    }
+
+    // adds a new unit or updates an existing one
+    void putUnit(int firmID, UnitID id, const Unit& unit) {
+        patch(firmID, [&](Snapshot& snapshot) {
+            snapshot.units[id] = unit;
+            rebuildConversions(snapshot);
+        });
+    }
+
+    void removeUnit(int firmID, UnitID id) {
+        patch(firmID, [&](Snapshot& snapshot) {
+            snapshot.units.erase(id);
+            rebuildConversions(snapshot);
+        });
+    }
+
+    void putIngredient(int firmID, IngredientID id, const Ingredient& ingredient) {
+        patch(firmID, [&](Snapshot& snapshot) { snapshot.ingredients[id] = ingredient; });
+    }
+
+    void removeIngredient(int firmID, IngredientID id) {
+        patch(firmID, [&](Snapshot& snapshot) { snapshot.ingredients.erase(id); });
+    }
+
+    // for changes which are easier to reload than to patch(e.g. import of many rows), next reader loads the firm again
+    void invalidate(int firmID) {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto& firm = firms[firmID];
+        firm.version++;
+        firm.current.reset();
+    }
+
+   private:
+    struct Firm {
+        SnapshotPtr current;  // empty if not loaded(or invalidated)
+        std::uint64_t version = 0;
+    };
+
+    FirmCatalog() = default;
+
+    // copy is made under the lock, so that two concurrent patches of a firm don't lose each other's changes
+    void patch(int firmID, std::function<void(Snapshot&)> change) {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto& firm = firms[firmID];
+        firm.version++;
+        if (!firm.current)
+            return;  // not loaded, it will be read from the database
+
+        auto patched = std::make_shared<Snapshot>(*firm.current);
+        change(*patched);
+        patched->version = firm.version;
+        firm.current = std::move(patched);
+    }
+
+    static void rebuildConversions(Snapshot& snapshot) {
+        auto rows = std::vector<UnitConversions::UnitRow>{};
+        rows.reserve(snapshot.units.size());
+        for (const auto& unit : snapshot.units) {
+            rows.push_back({unit.first, unit.second.baseUnitID, unit.second.quantity});
+        }
+
+        snapshot.conversions = UnitConversions{rows};
+    }
+
+    std::mutex mutex;
+    std::unordered_map<int, Firm> firms;
+};
@@ -0,0 +1,123 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <Wt/WServer>
+#include <Wt/WApplication>
+
+// Changes of shared data, published by the widget which made them and delivered to every other open widget of the same firm,
+// in other sessions too. Delivery uses WServer::post, so listeners run in their own session(with its lock held) and the browser is
+// updated through server push(WApplication::enableUpdates). Like FirmCatalog it assumes all sessions live in one server process.
+class FirmChanges {
+   public:
+    enum class Entity { Recipe, IngredientRecord, Ingredient, Unit };
+    enum class Kind { Added, Changed, Removed, Reloaded };  // Reloaded: many records at once(e.g. import), id is -1
+
+    struct Change {
+        Entity entity;
+        Kind kind;
+        long long id;
+        long long recipeID = -1;  // recipe of an ingredient record
+    };
+
+    using Listener = std::function<void(const Change&)>;
+
+    // unsubscribes when destroyed, so that listeners never outlive their widgets
+    class Subscription {
+       public:
+        Subscription() = default;
+        Subscription(const Subscription&) = delete;
+        Subscription& operator=(const Subscription&) = delete;
+
+        Subscription(Subscription&& other) : id(other.id) {
+            other.id = 0;
+        }
+
+        Subscription& operator=(Subscription&& other) {
+            std::swap(id, other.id);
+            return *this;
+        }
+
+        ~Subscription() {
+            if (id)
+                FirmChanges::instance().unsubscribe(id);
+        }
+
+       private:
+        friend class FirmChanges;
+        explicit Subscription(int id) : id(id) {}
+
+        int id = 0;
+    };
+
+    static FirmChanges& instance() {
+        static FirmChanges changes;
+        return changes;
+    }
+
+    // has to be called from the session which will handle the changes
+    Subscription subscribe(int firmID, Listener listener) {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto id = ++lastID;
+        listeners.emplace(id, Entry{firmID, Wt::WApplication::instance()->sessionId(), std::move(listener)});
+        return Subscription{id};
+    }
+
+    // has to be called after the change was committed; source(the publishing widget) doesn't get its own change
+    void publish(int firmID, const Change& change, const Subscription& source) {
+        auto server = Wt::WServer::instance();
+        if (!server)
+            return;  // e.g. command line tools, there are no sessions
+
+        auto targets = std::vector<std::pair<int, std::string>>{};
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            for (const auto& entry : listeners) {
+                if (entry.second.firmID == firmID && entry.first != source.id)
+                    targets.emplace_back(entry.first, entry.second.sessionID);
+            }
+        }
+
+        for (const auto& target : targets) {
+            auto id = target.first;
+            server->post(target.second, [this, id, change] { deliver(id, change); });
+        }
+    }
+
+   private:
+    struct Entry {
+        int firmID;
+        std::string sessionID;
+        Listener listener;
+    };
+
+    FirmChanges() = default;
+
+    // runs in the target session, which may have unsubscribed(e.g. logged out) after the change was posted
+    void deliver(int id, const Change& change) {
+        auto listener = Listener{};
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            auto entry = listeners.find(id);
+            if (entry == listeners.end())
+                return;
+
+            listener = entry->second.listener;
+        }
+
+        listener(change);
+        Wt::WApplication::instance()->triggerUpdate();
+    }
+
+    void unsubscribe(int id) {
+        std::lock_guard<std::mutex> lock{mutex};
+        listeners.erase(id);
+    }
+
+    std::mutex mutex;
+    int lastID = 0;
+    std::map<int, Entry> listeners;
+};
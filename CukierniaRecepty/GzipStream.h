@@ -0,0 +1,40 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <stdexcept>
+#include <zlib.h>
+
+// gzip compression of a response written in parts(e.g. chunks of a WResource sent through continuations), the state is kept between them.
+// Every part is flushed, so that the client can decompress what it got so far.
+class GzipStream {
+   public:
+    GzipStream() {
+        // 16 added to the window bits makes zlib write the gzip header and trailer
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            throw std::runtime_error("GzipStream: deflateInit2 failed");
+    }
+
+    GzipStream(const GzipStream&) = delete;
+    GzipStream& operator=(const GzipStream&) = delete;
+
+    ~GzipStream() {
+        deflateEnd(&stream);
+    }
+
+    // last part ends the gzip stream, nothing can be written after it
+    void write(const std::string& data, bool last, std::ostream& out) {
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream.avail_in = static_cast<uInt>(data.size());
+
+        char buffer[16 * 1024];
+        do {
+            stream.next_out = reinterpret_cast<Bytef*>(buffer);
+            stream.avail_out = sizeof(buffer);
+            deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+            out.write(buffer, sizeof(buffer) - stream.avail_out);
+        } while (stream.avail_out == 0);
+    }
+
+   private:
+    z_stream stream{};
+};
@@ -2,6 +2,8 @@
 #include <Wt/Dbo/Dbo>
 #include <Wt/Dbo/WtSqlTraits>
 #include "Unit.h"
+#include "NutritionVector.h"
+#include "SchemaIndex.h"
 
 class Ingredient {
    public:
@@ -31,4 +33,21 @@ class Ingredient {
         Wt::Dbo::field(action, unitID, "unit_id");
         Wt::Dbo::field(action, ownerID, "owner_id");
     }
+
+    static std::vector<SchemaIndex> indexes() {
+        return {{"ingredient_owner_name", {"owner_id", "name(64)"}}, {"ingredient_unit", {"unit_id"}}};
+    }
+
+    NutritionVector values() const {
+        auto result = NutritionVector{};
+        result.price = price;
+        result.kcal = kcal;
+        result.fat = fat;
+        result.saturatedAcids = saturatedAcids;
+        result.carbohydrates = carbohydrates;
+        result.sugar = sugar;
+        result.protein = protein;
+        result.salt = salt;
+        return result;
+    }
 };
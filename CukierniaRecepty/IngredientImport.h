@@ -0,0 +1,411 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <istream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <Wt/Dbo/Dbo>
+#include <Wt/WLogger>
+#include "database.h"
+#include "Ingredient.h"
+#include "FirmCatalog.h"
+#include "FirmChanges.h"
+#include "RecipeTotals.h"
+#include "Tracing.h"
+
+// Records of a CSV file, read one at a time, so that a file of any size takes the memory of one record.
+// Quoted fields may contain delimiters, doubled quotes and line breaks. The delimiter is taken from the header line: spreadsheets
+// with a decimal comma(e.g. Polish Excel or LibreOffice) export with ';', others with ','.
+class CsvReader {
+   public:
+    static constexpr std::size_t maxRecordBytes = 64 * 1024;  // e.g. a file without line breaks isn't read into memory whole
+
+    explicit CsvReader(std::istream& in) : in(in) {}
+
+    // false at the end of the input
+    bool next(std::vector<std::string>& fields) {
+        if (delimiter)
+            return read(*in.rdbuf(), fields);
+
+        auto header = std::string{};
+        if (!std::getline(in, header))
+            return false;
+
+        if (header.compare(0, 3, "\xEF\xBB\xBF") == 0)
+            header.erase(0, 3);  // BOM of UTF-8
+
+        delimiter = std::count(header.begin(), header.end(), ';') > std::count(header.begin(), header.end(), ',') ? ';' : ',';
+        auto headerStream = std::istringstream{header};
+        return read(*headerStream.rdbuf(), fields);
+    }
+
+    // line the last record started on, from 1
+    int line() const {
+        return recordLine;
+    }
+
+   private:
+    bool read(std::streambuf& buffer, std::vector<std::string>& fields) {
+        using Traits = std::streambuf::traits_type;
+
+        auto c = buffer.sbumpc();
+        if (Traits::eq_int_type(c, Traits::eof()))
+            return false;
+
+        fields.clear();
+        recordLine = nextLine++;
+        auto field = std::string{};
+        auto size = std::size_t{0};
+        auto quoted = false;
+        while (!Traits::eq_int_type(c, Traits::eof())) {
+            auto ch = Traits::to_char_type(c);
+            if (++size > maxRecordBytes)
+                throw std::invalid_argument("wiersz " + std::to_string(recordLine) + " jest za długi");
+
+            if (quoted) {
+                if (ch == '"' && buffer.sgetc() == '"') {
+                    field += '"';
+                    buffer.sbumpc();
+                } else if (ch == '"') {
+                    quoted = false;
+                } else {
+                    nextLine += ch == '\n';
+                    field += ch;
+                }
+            } else if (ch == '"') {
+                quoted = true;
+            } else if (ch == delimiter) {
+                fields.push_back(std::move(field));
+                field.clear();
+            } else if (ch == '\n') {
+                break;
+            } else if (ch != '\r') {
+                field += ch;
+            }
+
+            c = buffer.sbumpc();
+        }
+
+        fields.push_back(std::move(field));
+        return true;
+    }
+
+    std::istream& in;
+    char delimiter = 0;  // 0 until the header is read
+    int recordLine = 0;
+    int nextLine = 1;
+};
+
+// Import of ingredients of a firm from CSV(e.g. a price list of a supplier, exported from a spreadsheet), used by the upload in
+// IngredientsWidget and by the --import-ingredients mode of the server. Columns are found by their headers, as in IngredientsWidget
+// or as in the database(e.g. "Cena" or "price"); only name and unit are required, units are matched by name.
+// Ingredients the firm already has(same name) are updated, the others are inserted with multi-row statements. Every chunk of rows
+// is one transaction, so chunks committed before a failure(e.g. lost connection) stay, and other sessions aren't blocked for long.
+class IngredientImport {
+   public:
+    struct Result {
+        int added = 0;
+        int updated = 0;
+        int skipped = 0;  // rows with errors
+        std::vector<std::string> errors;  // first maxErrors of them, with line numbers
+    };
+
+    // called after every committed chunk, bytes is how much of the input was read(0 if it can't be told, e.g. a pipe)
+    using Progress = std::function<void(const Result&, std::uint64_t bytes)>;
+
+    static constexpr std::size_t maxErrors = 20;
+    static constexpr std::size_t rowsPerTransaction = 1000;
+    static constexpr int maxRowsPerStatement = 100;
+
+    IngredientImport(Database& db, int firmID) : db(db), firmID(firmID) {}
+
+    // throws std::invalid_argument if the file can't be imported at all(e.g. no name column), with a message for the user
+    Result run(std::istream& in, const Progress& progress = nullptr) {
+        Tracing::Span span{"IngredientImport::run"};
+        auto started = std::chrono::steady_clock::now();
+        auto result = Result{};
+        try {
+            readRows(in, result, progress);
+        } catch (...) {
+            if (result.added + result.updated > 0)
+                finish(result);  // committed chunks stay in the database
+            throw;
+        }
+        finish(result);
+
+        Wt::log("notice") << "IngredientImport: firm " << firmID << ", " << result.added << " added, " << result.updated << " updated, "
+                          << result.skipped << " skipped, took "
+                          << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count() << "ms";
+        return result;
+    }
+
+   private:
+    using UnitID = FirmCatalog::UnitID;
+    using IngredientID = FirmCatalog::IngredientID;
+
+    enum Column { colName, colUnit, colPrice, colKcal, colFat, colSaturatedAcids, colCarbohydrates, colSugar, colProtein, colSalt, columnCount };
+
+    // in the order of placeholders of insert and update statements
+    static constexpr const char* valueColumns = "name, price, kcal, fat, saturated_acids, carbohydrates, sugar, protein, salt, unit_id";
+    static constexpr int valuesPerRow = 10;
+
+    void readRows(std::istream& in, Result& result, const Progress& progress) {
+        auto reader = CsvReader{in};
+        auto fields = std::vector<std::string>{};
+        if (!reader.next(fields))
+            throw std::invalid_argument("plik jest pusty");
+
+        auto columns = findColumns(fields);
+
+        // everything the rows are checked against is read once, from the catalog shared with the sessions
+        auto catalog = FirmCatalog::instance().snapshot(db, firmID);
+        auto units = std::unordered_map<std::string, UnitID>{};
+        for (const auto& unit : catalog->units) {
+            units.emplace(unit.second.name.toUTF8(), unit.first);
+        }
+
+        auto existing = std::unordered_map<std::string, IngredientID>{};
+        for (const auto& ingredient : catalog->ingredients) {
+            existing.emplace(ingredient.second.name.toUTF8(), ingredient.first);
+        }
+
+        auto seen = std::unordered_set<std::string>{};
+        auto inserts = std::vector<Ingredient>{};
+        auto updates = std::vector<std::pair<IngredientID, Ingredient>>{};
+        auto commit = [&](bool last) {
+            auto inserted = write(inserts, updates, last);
+            result.added += static_cast<int>(inserted);
+            result.updated += static_cast<int>(updates.size());
+            inserts.erase(inserts.begin(), inserts.begin() + inserted);
+            updates.clear();
+
+            if (progress) {
+                auto position = in.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::in);
+                progress(result, position > 0 ? static_cast<std::uint64_t>(position) : 0);
+            }
+        };
+
+        while (reader.next(fields)) {
+            if (std::all_of(fields.begin(), fields.end(), [](const std::string& field) { return trimmed(field).empty(); }))
+                continue;
+
+            auto name = trimmed(field(fields, columns[colName]));
+            if (name.empty()) {
+                fail(result, reader.line(), "brak nazwy");
+                continue;
+            }
+
+            if (!seen.insert(name).second) {
+                fail(result, reader.line(), "składnik \"" + name + "\" powtarza się w pliku");
+                continue;
+            }
+
+            // values missing in the file are kept as they are(or are 0 for new ingredients)
+            auto found = existing.find(name);
+            auto ingredient = found != existing.end() ? *catalog->ingredient(found->second) : Ingredient{};
+            ingredient.name = Wt::WString::fromUTF8(name);
+            ingredient.ownerID = firmID;
+
+            auto error = readValues(fields, columns, units, ingredient);
+            if (!error.empty()) {
+                fail(result, reader.line(), error);
+                continue;
+            }
+
+            if (found != existing.end())
+                updates.emplace_back(found->second, std::move(ingredient));
+            else
+                inserts.push_back(std::move(ingredient));
+
+            if (inserts.size() + updates.size() >= rowsPerTransaction)
+                commit(false);
+        }
+
+        if (!inserts.empty() || !updates.empty())
+            commit(true);
+    }
+
+    static std::vector<int> findColumns(const std::vector<std::string>& header) {
+        static const std::vector<std::pair<std::string, Column>> names = {
+            {"nazwa", colName},        {"name", colName},
+            {"jednostka", colUnit},    {"unit", colUnit},
+            {"cena", colPrice},        {"price", colPrice},
+            {"kaloryczność", colKcal}, {"energia", colKcal},           {"kcal", colKcal},
+            {"tłuszcze", colFat},      {"fat", colFat},
+            {"kwasy nasycone", colSaturatedAcids},                     {"saturated_acids", colSaturatedAcids},
+            {"węglowodany", colCarbohydrates},                         {"carbohydrates", colCarbohydrates},
+            {"cukry", colSugar},       {"sugar", colSugar},
+            {"białka", colProtein},    {"białko", colProtein},        {"protein", colProtein},
+            {"sól", colSalt},          {"salt", colSalt},
+        };
+
+        auto columns = std::vector<int>(columnCount, -1);
+        for (auto i = 0u; i < header.size(); i++) {
+            auto name = trimmed(header[i]);
+            std::transform(name.begin(), name.end(), name.begin(), [](char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; });
+            for (const auto& known : names) {
+                if (known.first == name && columns[known.second] == -1)
+                    columns[known.second] = static_cast<int>(i);
+            }
+        }
+
+        if (columns[colName] == -1)
+            throw std::invalid_argument("brak kolumny \"Nazwa\" w pierwszym wierszu");
+        if (columns[colUnit] == -1)
+            throw std::invalid_argument("brak kolumny \"Jednostka\" w pierwszym wierszu");
+
+        return columns;
+    }
+
+    // empty if the values are correct
+    static std::string readValues(const std::vector<std::string>& fields, const std::vector<int>& columns,
+                                  const std::unordered_map<std::string, UnitID>& units, Ingredient& ingredient) {
+        auto unitName = trimmed(field(fields, columns[colUnit]));
+        auto unit = units.find(unitName);
+        if (unit == units.end())
+            return "nieznana jednostka \"" + unitName + "\"";
+        ingredient.unitID = unit->second;
+
+        static const std::vector<std::pair<Column, double Ingredient::*>> numbers = {
+            {colPrice, &Ingredient::price},   {colFat, &Ingredient::fat},       {colSaturatedAcids, &Ingredient::saturatedAcids},
+            {colCarbohydrates, &Ingredient::carbohydrates},                     {colSugar, &Ingredient::sugar},
+            {colProtein, &Ingredient::protein}, {colSalt, &Ingredient::salt},
+        };
+
+        for (const auto& number : numbers) {
+            if (!readNumber(field(fields, columns[number.first]), ingredient.*number.second))
+                return "niepoprawna liczba \"" + field(fields, columns[number.first]) + "\"";
+        }
+
+        auto kcal = static_cast<double>(ingredient.kcal);
+        if (!readNumber(field(fields, columns[colKcal]), kcal))
+            return "niepoprawna liczba \"" + field(fields, columns[colKcal]) + "\"";
+        ingredient.kcal = static_cast<int>(std::lround(kcal));
+
+        return "";
+    }
+
+    // value stays as it is if the text is empty; accepts a decimal comma
+    static bool readNumber(const std::string& text, double& value) {
+        auto number = trimmed(text);
+        if (number.empty())
+            return true;
+
+        std::replace(number.begin(), number.end(), ',', '.');
+        try {
+            auto end = std::size_t{0};
+            auto parsed = std::stod(number, &end);
+            if (end != number.size() || parsed < 0 || !std::isfinite(parsed))
+                return false;
+
+            value = parsed;
+            return true;
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+
+    // rows shorter than the header(e.g. trailing empty cells cut off by the spreadsheet) have empty fields
+    static std::string field(const std::vector<std::string>& fields, int column) {
+        return column >= 0 && column < static_cast<int>(fields.size()) ? fields[column] : std::string{};
+    }
+
+    static std::string trimmed(const std::string& text) {
+        auto begin = text.find_first_not_of(" \t");
+        if (begin == std::string::npos)
+            return "";
+
+        return text.substr(begin, text.find_last_not_of(" \t") - begin + 1);
+    }
+
+    static void fail(Result& result, int line, const std::string& error) {
+        result.skipped++;
+        if (result.errors.size() < maxErrors)
+            result.errors.push_back("wiersz " + std::to_string(line) + ": " + error);
+    }
+
+    // one chunk, in one transaction; inserts which don't fill a whole statement are left for the next chunk unless it's the last one,
+    // returns how many were inserted
+    std::size_t write(const std::vector<Ingredient>& inserts, const std::vector<std::pair<IngredientID, Ingredient>>& updates, bool last) {
+        Tracing::Span span{"IngredientImport::write"};
+        auto limit = db.dialect().maxBindParameters() / (valuesPerRow + 1);
+        auto perStatement = static_cast<std::size_t>(limit < maxRowsPerStatement ? std::max(limit, 1) : maxRowsPerStatement);
+
+        Wt::Dbo::Transaction transaction{db};
+        auto row = std::size_t{0};
+        auto batchSql = insertSql(perStatement);
+        for (; row + perStatement <= inserts.size(); row += perStatement) {
+            auto call = db.execute(batchSql);
+            for (auto i = row; i < row + perStatement; i++) {
+                bindValues(call.bind(firmID), inserts[i]);
+            }
+        }
+
+        // the rest of the file one by one, so that there are only two insert statements to prepare(and to report in metrics)
+        auto sql = insertSql(1);
+        for (; last && row < inserts.size(); row++) {
+            auto call = db.execute(sql);
+            bindValues(call.bind(firmID), inserts[row]);
+        }
+
+        // version is raised, so that sessions holding a loaded ingredient don't overwrite the import unknowingly
+        auto updateSql = std::string{"update ingredient set name = ?, price = ?, kcal = ?, fat = ?, saturated_acids = ?, carbohydrates = ?, "
+                                     "sugar = ?, protein = ?, salt = ?, unit_id = ?, version = version + 1 where id = ?"};
+        for (const auto& update : updates) {
+            auto call = db.execute(updateSql);
+            bindValues(call, update.second).bind(update.first);
+        }
+
+        transaction.commit();
+        return row;
+    }
+
+    // owner_id and the values of each row are placeholders
+    static std::string insertSql(std::size_t rows) {
+        auto row = std::string{"(0"};
+        for (auto i = 0; i <= valuesPerRow; i++) {
+            row += ", ?";
+        }
+        row += ")";
+
+        auto sql = std::string{"insert into ingredient (version, owner_id, "} + valueColumns + ") values " + row;
+        for (auto i = std::size_t{1}; i < rows; i++) {
+            sql += ", " + row;
+        }
+
+        return sql;
+    }
+
+    static Wt::Dbo::Call& bindValues(Wt::Dbo::Call& call, const Ingredient& ingredient) {
+        return call.bind(ingredient.name.toUTF8())
+            .bind(ingredient.price)
+            .bind(ingredient.kcal)
+            .bind(ingredient.fat)
+            .bind(ingredient.saturatedAcids)
+            .bind(ingredient.carbohydrates)
+            .bind(ingredient.sugar)
+            .bind(ingredient.protein)
+            .bind(ingredient.salt)
+            .bind(ingredient.unitID);
+    }
+
+    // catalogs and totals of the firm are refreshed once for the whole import
+    void finish(const Result& result) {
+        FirmCatalog::instance().invalidate(firmID);
+        if (result.updated > 0)
+            RecipeTotals::firmChanged(db, firmID);
+
+        FirmChanges::instance().publish(firmID, {FirmChanges::Entity::Ingredient, FirmChanges::Kind::Reloaded, -1}, FirmChanges::Subscription{});
+    }
+
+    Database& db;
+    int firmID;
+};
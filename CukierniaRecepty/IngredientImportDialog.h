@@ -0,0 +1,243 @@
+#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <Wt/WServer>
+#include <Wt/WLogger>
+#include <Wt/WApplication>
+#include <Wt/WDialog>
+#include <Wt/WText>
+#include <Wt/WBreak>
+#include <Wt/WFileUpload>
+#include <Wt/WProgressBar>
+#include <Wt/WPushButton>
+#include <Wt/WContainerWidget>
+#include "database.h"
+#include "Schema.h"
+#include "IngredientImport.h"
+
+// Thread which runs imports, one at a time, so that a large file doesn't hold one of the server's request threads for the whole import
+// (same idea as PasswordHashing). Started with the first import; main() stops it before the connection pool the jobs use is gone.
+class IngredientImportThread {
+   public:
+    static IngredientImportThread& instance() {
+        static IngredientImportThread thread;
+        return thread;
+    }
+
+    // false if another import is running
+    bool submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            if (busy)
+                return false;
+
+            if (!thread.joinable())
+                thread = std::thread([this] { run(); });
+
+            pending = std::move(job);
+            busy = true;
+        }
+
+        jobAvailable.notify_one();
+        return true;
+    }
+
+    // waits for the running import(if any), nothing can be submitted afterwards
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+            busy = true;
+        }
+        jobAvailable.notify_all();
+
+        if (thread.joinable())
+            thread.join();
+    }
+
+    ~IngredientImportThread() {
+        stop();
+    }
+
+   private:
+    IngredientImportThread() = default;
+
+    void run() {
+        while (true) {
+            auto job = std::function<void()>{};
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                jobAvailable.wait(lock, [this] { return stopping || pending; });
+                if (!pending)
+                    return;  // stopping
+
+                job = std::move(pending);
+                pending = nullptr;
+            }
+
+            try {
+                job();
+            } catch (const std::exception& e) {
+                Wt::log("error") << "IngredientImportThread: " << e.what();
+            }
+
+            std::lock_guard<std::mutex> lock{mutex};
+            busy = false;
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::function<void()> pending;
+    std::thread thread;
+    bool busy = false;  // from submit until the job is done
+    bool stopping = false;
+};
+
+// Upload of a CSV file with ingredients of the firm(see IngredientImport). The file is spooled to disk by Wt and imported on
+// IngredientImportThread with its own Dbo session, so this session isn't blocked; progress comes back through server push.
+// Only one import runs in the server at a time, and the dialog can't be closed until it's done.
+class IngredientImportDialog : public Wt::WDialog {
+   public:
+    explicit IngredientImportDialog(Database& db) : WDialog(L"Import składników"), db(db) {
+        new Wt::WText(L"Plik CSV (UTF-8) z nagłówkami kolumn jak w tabeli składników, wymagane są Nazwa i Jednostka. "
+                      L"Składniki o nazwach, które już istnieją, zostaną zaktualizowane.", contents());
+        new Wt::WBreak(contents());
+        upload = new Wt::WFileUpload(contents());
+        upload->setFilters(".csv,text/csv");
+        upload->uploaded().connect(this, &IngredientImportDialog::startImport);
+        upload->fileTooLarge().connect(std::bind([this] { showError(L"Plik jest za duży"); }));
+
+        progress = new Wt::WProgressBar(contents());
+        progress->hide();
+        status = new Wt::WContainerWidget(contents());
+
+        importButton = new Wt::WPushButton("Importuj", footer());
+        importButton->setDefault(true);
+        importButton->clicked().connect(std::bind([this] {
+            if (!upload->canUpload()) {
+                showError(L"Wybierz plik");
+                return;
+            }
+
+            importButton->disable();
+            closeButton->disable();
+            status->clear();
+            upload->upload();
+        }));
+
+        closeButton = new Wt::WPushButton("Zamknij", footer());
+        closeButton->clicked().connect(this, &Wt::WDialog::reject);
+    }
+
+   private:
+    using Result = IngredientImport::Result;
+
+    void startImport() {
+        if (upload->empty()) {
+            showError(L"Wybierz plik");
+            return;
+        }
+
+        // the job gets only values, this dialog may be gone(e.g. logout) before it's done
+        auto file = upload->spoolFileName();
+        auto sessionID = Wt::WApplication::instance()->sessionId();
+        auto pool = &db.pool();
+        auto firmID = db.currentUser().firmID;
+        auto alive = std::weak_ptr<int>{guard};
+        auto submitted = IngredientImportThread::instance().submit([this, sessionID, pool, firmID, file, alive] {
+            // session may be gone already, then post does nothing
+            auto post = [=](std::function<void()> update) {
+                auto server = Wt::WServer::instance();
+                if (!server)
+                    return;
+
+                server->post(sessionID, [alive, update] {
+                    if (alive.lock()) {
+                        update();
+                        Wt::WApplication::instance()->triggerUpdate();
+                    }
+                });
+            };
+
+            try {
+                auto in = std::ifstream{file, std::ios::binary | std::ios::ate};
+                auto size = static_cast<std::uint64_t>(std::max<std::streamoff>(in.tellg(), 0));
+                in.seekg(0);
+
+                Database importDb{*pool};
+                Schema::mapClasses(importDb);
+                auto result = IngredientImport{importDb, firmID}.run(in, [&](const Result& done, std::uint64_t bytes) {
+                    post([this, done, bytes, size] { showProgress(done, bytes, size); });
+                });
+                post([this, result] { finishImport(result, L""); });
+            } catch (const std::exception& e) {
+                Wt::log("error") << "IngredientImport: " << e.what();
+                auto error = Wt::WString::fromUTF8(e.what());
+                post([this, error] { finishImport(Result{}, error); });
+            }
+
+            std::remove(file.c_str());
+        });
+
+        if (!submitted) {
+            showError(L"Trwa inny import, spróbuj ponownie za chwilę");
+            return;
+        }
+
+        // from now on the job deletes the file
+        upload->stealSpooledFile();
+        progress->setValue(0);
+        progress->show();
+    }
+
+    void showProgress(const Result& done, std::uint64_t bytes, std::uint64_t size) {
+        if (size > 0)
+            progress->setValue(100.0 * bytes / size);
+
+        status->clear();
+        new Wt::WText(Wt::WString(L"Zaimportowano {1} wierszy").arg(done.added + done.updated), status);
+    }
+
+    // error is empty if the file was read to the end, otherwise chunks committed before it stay imported
+    void finishImport(const Result& result, const Wt::WString& error) {
+        importButton->enable();
+        closeButton->enable();
+        progress->hide();
+        status->clear();
+
+        if (!error.empty()) {
+            showError(Wt::WString(L"Import przerwany: {1}").arg(error));
+            return;
+        }
+
+        new Wt::WText(Wt::WString(L"Dodano {1}, zaktualizowano {2}, pominięto {3} wierszy").arg(result.added).arg(result.updated).arg(result.skipped), status);
+        for (const auto& rowError : result.errors) {
+            new Wt::WBreak(status);
+            new Wt::WText(Wt::WString::fromUTF8(rowError), Wt::PlainText, status);
+        }
+    }
+
+    void showError(const Wt::WString& error) {
+        importButton->enable();
+        closeButton->enable();
+        new Wt::WText(error, Wt::PlainText, status);
+        new Wt::WBreak(status);
+    }
+
+    Database& db;
+    Wt::WFileUpload* upload;
+    Wt::WProgressBar* progress;
+    Wt::WContainerWidget* status;
+    Wt::WPushButton* importButton;
+    Wt::WPushButton* closeButton;
+    std::shared_ptr<int> guard = std::make_shared<int>(0);  // posted progress checks it before touching the dialog
+};
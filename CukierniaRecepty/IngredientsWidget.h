@@ -1,13 +1,22 @@
 #pragma once
 #include <memory>
-#include <unordered_map>
 #include <Wt/Dbo/Session>
 #include <Wt/WLineEdit>
 #include <Wt/WDialog>
 #include <Wt/WPushButton>
 #include <Wt/WDoubleValidator>
 #include <Wt/WIntValidator>
+#include <Wt/WTableView>
+#include <boost/tuple/tuple.hpp>
 #include "helpers.h"
+#include "QueryTableModel.h"
+#include "ComboBoxDelegate.h"
+#include "References.h"
+#include "FirmCatalog.h"
+#include "FirmChanges.h"
+#include "RecipeTotals.h"
+#include "Tracing.h"
+#include "IngredientImportDialog.h"
 #include "Ingredient.h"
 #include "Unit.h"
 #include "Recipe.h"
@@ -26,29 +35,45 @@ class IngredientsWidget : public Wt::WContainerWidget {
     const std::wstring colDelete = L"Usuń";
    public:
     IngredientsWidget(Wt::WContainerWidget*, Database& db) : db(&db) {
-        if(db.users->find(db.login.user())->user()->accessLevel !=  0) {
+        if(db.currentUser().canEdit()) {
             addButton = std::make_unique<Wt::WPushButton>(L"Dodaj składnik", this);
             addButton->clicked().connect(this, &IngredientsWidget::showAddDialog);
+            importButton = std::make_unique<Wt::WPushButton>(L"Importuj z CSV", this);
+            importButton->clicked().connect(std::bind([this] {
+                importDialog = std::make_unique<IngredientImportDialog>(*this->db);
+                importDialog->finished().connect(std::bind([this] { importDialog = nullptr; }));
+                importDialog->show();
+            }));
         }
 
-        ingredientList = std::make_unique<Wt::WTable>(this);
-        ingredientList->addStyleClass("table table-stripped table-bordered");
-        populateIngredientList();
+        ingredientList = std::make_unique<Wt::WTableView>(this);
+        ingredientList->setAlternatingRowColors(true);
+        ingredientList->setHeight(600);
+        ingredientList->setEditTriggers(Wt::WAbstractItemView::SingleClicked);
+        ingredientList->clicked().connect(std::bind([this](const Wt::WModelIndex& index) { cellClicked(index); }, std::placeholders::_1));
+
+        createModel(db.currentUser().canEdit());
+        changes = FirmChanges::instance().subscribe(db.currentUser().firmID, [this](const FirmChanges::Change& change) { applyChange(change); });
     }
 
     void populateIngredientList() {
-        populateIngredientTable();
-        if(db->users->find(db->login.user())->user()->accessLevel !=  0) {
-            makeTableEditable();
-            setupDeleteAction();
-        }
+        Tracing::Span span{"IngredientsWidget::populateIngredientList"};
+        model->reload();
     }
 
    private:
+    // ingredient with name of its unit(empty if the unit doesn't exist)
+    using IngredientRow = boost::tuple<Wt::Dbo::ptr<Ingredient>, Wt::WString>;
+    using Column = QueryTableModel<IngredientRow>::Column;
+
     Database* db;
-    std::unique_ptr<Wt::WTable> ingredientList;
-    std::unordered_map<int, Wt::Dbo::dbo_traits<Ingredient>::IdType> rowToID;
+    std::unique_ptr<QueryTableModel<IngredientRow>> model;
+    std::unique_ptr<ComboBoxDelegate> unitDelegate;
+    std::unique_ptr<Wt::WTableView> ingredientList;
     std::unique_ptr<Wt::WPushButton> addButton;
+    std::unique_ptr<Wt::WPushButton> importButton;
+    std::unique_ptr<IngredientImportDialog> importDialog;  // owned, so that an import in progress stops reporting to it when the widget is gone
+    FirmChanges::Subscription changes;
 
     Wt::WDoubleValidator* createNutritionValidator(Wt::WLineEdit* field) {
         auto validator = new Wt::WDoubleValidator;
@@ -79,8 +104,7 @@ class IngredientsWidget : public Wt::WContainerWidget {
         auto proteinField = createLabeledField<Wt::WLineEdit>(L"Białko", dialog->contents());
         auto saltField = createLabeledField<Wt::WLineEdit>(L"Sól", dialog->contents());
         auto unitField = createLabeledField<Wt::WComboBox>("Jednostka", dialog->contents());
-        auto unitIDs = populateComboBox<Unit>(*db, *unitField, [](const Unit& elem) { return elem.name; },
-            [this](const Wt::Dbo::ptr<Unit>& elem) { return elem->ownerID == db->users->find(db->login.user())->user()->firmID; });
+        auto unitIDs = populateComboBox(*unitField, FirmCatalog::instance().snapshot(*db, db->currentUser().firmID)->units);
         auto validationInfo = new Wt::WText(dialog->contents());
 
         // setup validators
@@ -134,8 +158,15 @@ class IngredientsWidget : public Wt::WContainerWidget {
                 ingredient->protein = std::stod(proteinField->text());
                 ingredient->salt = std::stod(saltField->text());
                 ingredient->unitID = unitIDs[unitField->currentIndex()];
-                ingredient->ownerID = db->users->find(db->login.user())->user()->firmID;
-                db->add<Ingredient>(ingredient);
+                ingredient->ownerID = db->currentUser().firmID;
+
+                Wt::Dbo::Transaction transaction(*db);
+                auto added = db->add<Ingredient>(ingredient);
+                db->flush();
+                transaction.commit();
+
+                FirmCatalog::instance().putIngredient(added->ownerID, added.id(), *added);
+                publish(FirmChanges::Kind::Added, added.id());
                 populateIngredientList();
             }
 
@@ -145,231 +176,216 @@ class IngredientsWidget : public Wt::WContainerWidget {
         dialog->show();
     }
 
-    void populateIngredientTable() {
-        rowToID.clear();
-        populateTable<Ingredient>(*db, *ingredientList, [&](const Wt::Dbo::ptr<Ingredient>& ingredient, int row) {
-            rowToID.insert(std::make_pair(row, ingredient.id()));
-            auto transaction = Wt::Dbo::Transaction{*db};
-
-            std::vector<std::pair<std::wstring, Wt::WString>> columns;
-
-            Wt::Dbo::ptr<Unit> unit = db->find<Unit>().where("id = ?").bind(ingredient->unitID);
-            auto unitName = unit.id() != Wt::Dbo::dbo_traits<Unit>::invalidId() ? unit->name : L"Błędna jednostka";
-
-            columns.emplace_back(colName, ingredient->name);
-            columns.emplace_back(colUnit, unitName);
-            if(db->users->find(db->login.user())->user()->accessLevel !=  0)
-                columns.emplace_back(colPrice, std::to_string(ingredient->price));
-
-            columns.emplace_back(colKcal, std::to_string(ingredient->kcal));
-            columns.emplace_back(colFats, std::to_string(ingredient->fat));
-            columns.emplace_back(colSatAcids, std::to_string(ingredient->saturatedAcids));
-            columns.emplace_back(colCarbs, std::to_string(ingredient->carbohydrates));
-            columns.emplace_back(colSugar, std::to_string(ingredient->sugar));
-            columns.emplace_back(colProtein, std::to_string(ingredient->protein));
-            columns.emplace_back(colSalt, std::to_string(ingredient->salt));
-
-            if(db->users->find(db->login.user())->user()->accessLevel !=  0)
-                columns.emplace_back(colDelete, "X");
-
-            return columns;
-        },
-        [this](const Wt::Dbo::ptr<Ingredient>& ingredient) {
-            Wt::Dbo::Transaction t{*db};
-            return ingredient->ownerID == db->users->find(db->login.user())->user()->firmID;
-        });
-    }
-
-    void makeTableEditable() {
-        // make ingredient name editable
-        makeTextCellsInteractive(*ingredientList, colName, [&](int row, const Wt::WLineEdit& filledField, Wt::WString oldContent) {
-            if (Wt::WValidator(true).validate(filledField.text()).state() != Wt::WValidator::Valid) {
-                return oldContent;
-            }
-
-            Wt::Dbo::Transaction transaction(*db);
-            Wt::Dbo::ptr<Ingredient> ingredient = db->find<Ingredient>().where("id = ?").bind(rowToID[row]);
-            ingredient.modify()->name = filledField.text();
-            return Wt::WString(ingredient->name);
-        });
+    void createModel(bool editable) {
+        std::vector<Column> columns;
 
-        // make kcal editable
-        makeTextCellsInteractive(*ingredientList, colKcal, [&](int row, const Wt::WLineEdit& filledField, Wt::WString oldContent) {
-            if (Wt::WIntValidator().validate(filledField.text()).state() != Wt::WValidator::Valid) {
-                return oldContent;
-            }
-
-            Wt::Dbo::Transaction transaction(*db);
-            Wt::Dbo::ptr<Ingredient> ingredient = db->find<Ingredient>().where("id = ?").bind(rowToID[row]);
-            ingredient.modify()->kcal = std::stoi(filledField.text());
-            return Wt::WString(filledField.text());
-        });
+        auto nameColumn = Column{colName, [](const IngredientRow& row) { return row.get<0>()->name; }, "i.name"};
+        if (editable)
+            nameColumn.edit = [this](const IngredientRow& row, const boost::any& value) {
+                auto name = Wt::asString(value);
+                if (Wt::WValidator(true).validate(name).state() != Wt::WValidator::Valid) {
+                    return false;
+                }
 
-        // make fat editable
-        makeTextCellsInteractive(*ingredientList, colFats, [&](int row, const Wt::WLineEdit& filledField, Wt::WString oldContent) {
-            if (Wt::WDoubleValidator().validate(filledField.text()).state() != Wt::WValidator::Valid) {
-                return oldContent;
+                changeIngredient(row.get<0>(), [&name](Ingredient& ingredient) { ingredient.name = name; });
+                return true;
+            };
+        columns.push_back(nameColumn);
+
+        auto unitColumn = Column{colUnit, [](const IngredientRow& row) {
+                                     return row.get<1>().empty() ? Wt::WString(L"Błędna jednostka") : row.get<1>();
+                                 }, "u.name"};
+        if (editable)
+            unitColumn.edit = [this](const IngredientRow& row, const boost::any& value) {
+                auto unitID = boost::any_cast<ComboBoxDelegate::IdType>(value);
+                changeIngredient(row.get<0>(), [unitID](Ingredient& ingredient) { ingredient.unitID = unitID; });
+                return true;
+            };
+        columns.push_back(unitColumn);
+
+        if (editable)
+            columns.push_back(numberColumn(colPrice, "i.price", &Ingredient::price, editable));
+
+        columns.push_back(numberColumn(colKcal, "i.kcal", &Ingredient::kcal, editable));
+        columns.push_back(numberColumn(colFats, "i.fat", &Ingredient::fat, editable));
+        columns.push_back(numberColumn(colSatAcids, "i.saturated_acids", &Ingredient::saturatedAcids, editable));
+        columns.push_back(numberColumn(colCarbs, "i.carbohydrates", &Ingredient::carbohydrates, editable));
+        columns.push_back(numberColumn(colSugar, "i.sugar", &Ingredient::sugar, editable));
+        columns.push_back(numberColumn(colProtein, "i.protein", &Ingredient::protein, editable));
+        columns.push_back(numberColumn(colSalt, "i.salt", &Ingredient::salt, editable));
+
+        if (editable)
+            columns.push_back({colDelete, [](const IngredientRow&) { return Wt::WString("X"); }, ""});
+
+        model = std::make_unique<QueryTableModel<IngredientRow>>(
+            std::move(columns),
+            [this] {
+                auto transaction = Wt::Dbo::Transaction{*db};
+                int ingredients = db->query<int>("select count(1) from ingredient").where("owner_id = ?").bind(db->currentUser().firmID);
+                return ingredients;
+            },
+            [this](int offset, int limit, const std::string& orderBy) {
+                Tracing::Span span{"IngredientsWidget::fetchIngredients"};
+                auto transaction = Wt::Dbo::Transaction{*db};
+                Wt::Dbo::collection<IngredientRow> rows = rowQuery().orderBy(orderBy + ", i.id").limit(limit).offset(offset);
+                return std::vector<IngredientRow>(rows.begin(), rows.end());
+            },
+            [this](Wt::Dbo::dbo_traits<Ingredient>::IdType id) -> boost::optional<IngredientRow> {
+                auto transaction = Wt::Dbo::Transaction{*db};
+                Wt::Dbo::collection<IngredientRow> rows = rowQuery().where("i.id = ?").bind(id);
+                for (const auto& row : rows)
+                    return boost::make_optional(row);
+                return boost::optional<IngredientRow>();
+            },
+            [](const IngredientRow& row) { return row.get<0>().id(); },
+            "i.name");
+
+        ingredientList->setModel(model.get());
+        if (model->columnOf(colDelete) != -1)
+            ingredientList->setSortingEnabled(model->columnOf(colDelete), false);
+
+        // only units which can be converted to the current one make sense
+        unitDelegate = std::make_unique<ComboBoxDelegate>([this](const Wt::WModelIndex& index) {
+            auto catalog = FirmCatalog::instance().snapshot(*db, db->currentUser().firmID);
+            auto ingredient = catalog->ingredient(model->idAt(index.row()));
+
+            auto options = ComboBoxDelegate::Options{};
+            for (const auto& unit : catalog->units) {
+                if (ingredient && Unit::sameBranch(catalog->conversions, unit.first, ingredient->unitID))
+                    options.emplace_back(unit.first, unit.second.name);
             }
 
-            Wt::Dbo::Transaction transaction(*db);
-            Wt::Dbo::ptr<Ingredient> ingredient = db->find<Ingredient>().where("id = ?").bind(rowToID[row]);
-            ingredient.modify()->fat = std::stod(filledField.text());
-            return Wt::WString(filledField.text());
+            return options;
         });
+        ingredientList->setItemDelegateForColumn(model->columnOf(colUnit), unitDelegate.get());
+    }
 
-        // make saturated acids editable
-        makeTextCellsInteractive(*ingredientList, colSatAcids, [&](int row, const Wt::WLineEdit& filledField, Wt::WString oldContent) {
-            if (Wt::WDoubleValidator().validate(filledField.text()).state() != Wt::WValidator::Valid) {
-                return oldContent;
-            }
+    // commits the change right away, so that other sessions can see it in the catalog
+    void changeIngredient(Wt::Dbo::ptr<Ingredient> ingredient, std::function<void(Ingredient&)> change) {
+        Wt::Dbo::Transaction transaction(*db);
+        auto oldName = ingredient->name;
+        change(*ingredient.modify());
+        if (ingredient->name == oldName)
+            RecipeTotals::ingredientChanged(*db, ingredient->ownerID, ingredient.id());  // values or unit
 
-            Wt::Dbo::Transaction transaction(*db);
-            Wt::Dbo::ptr<Ingredient> ingredient = db->find<Ingredient>().where("id = ?").bind(rowToID[row]);
-            ingredient.modify()->saturatedAcids = std::stod(filledField.text());
-            return Wt::WString(filledField.text());
-        });
+        transaction.commit();
 
-        // make carbohydrates editable
-        makeTextCellsInteractive(*ingredientList, colCarbs, [&](int row, const Wt::WLineEdit& filledField, Wt::WString oldContent) {
-            if (Wt::WDoubleValidator().validate(filledField.text()).state() != Wt::WValidator::Valid) {
-                return oldContent;
-            }
+        FirmCatalog::instance().putIngredient(ingredient->ownerID, ingredient.id(), *ingredient);
+        publish(FirmChanges::Kind::Changed, ingredient.id());
+    }
 
-            Wt::Dbo::Transaction transaction(*db);
-            Wt::Dbo::ptr<Ingredient> ingredient = db->find<Ingredient>().where("id = ?").bind(rowToID[row]);
-            ingredient.modify()->carbohydrates = std::stod(filledField.text());
-            return Wt::WString(filledField.text());
-        });
+    void publish(FirmChanges::Kind kind, Wt::Dbo::dbo_traits<Ingredient>::IdType id) {
+        FirmChanges::instance().publish(db->currentUser().firmID, {FirmChanges::Entity::Ingredient, kind, id}, changes);
+    }
 
-        // make sugar editable
-        makeTextCellsInteractive(*ingredientList, colSugar, [&](int row, const Wt::WLineEdit& filledField, Wt::WString oldContent) {
-            if (Wt::WDoubleValidator().validate(filledField.text()).state() != Wt::WValidator::Valid) {
-                return oldContent;
+    // change made by another widget(or session), only affected rows are read again
+    void applyChange(const FirmChanges::Change& change) {
+        if (change.entity == FirmChanges::Entity::Ingredient) {
+            if (change.kind == FirmChanges::Kind::Added) {
+                model->reload();
+            } else if (change.kind == FirmChanges::Kind::Removed) {
+                model->removeRecord(change.id);
+            } else if (change.kind == FirmChanges::Kind::Reloaded) {
+                db->rereadAll("ingredient");  // loaded ingredients may have been updated
+                model->reload();
+            } else {
+                reread<Ingredient>(*db, change.id);
+                model->refreshRecord(change.id);
             }
+        } else if (change.entity == FirmChanges::Entity::Unit && change.kind == FirmChanges::Kind::Changed) {
+            // rows show names of their units
+            model->refreshRows([&change](const IngredientRow& row) { return row.get<0>()->unitID == change.id; });
+        }
+    }
 
-            Wt::Dbo::Transaction transaction(*db);
-            Wt::Dbo::ptr<Ingredient> ingredient = db->find<Ingredient>().where("id = ?").bind(rowToID[row]);
-            ingredient.modify()->sugar = std::stod(filledField.text());
-            return Wt::WString(filledField.text());
-        });
+    Wt::Dbo::Query<IngredientRow> rowQuery() {
+        return db->query<IngredientRow>("select i, coalesce(u.name, '') from ingredient i left join unit u on u.id = i.unit_id")
+            .where("i.owner_id = ?").bind(db->currentUser().firmID);
+    }
 
-        // make protein editable
-        makeTextCellsInteractive(*ingredientList, colProtein, [&](int row, const Wt::WLineEdit& filledField, Wt::WString oldContent) {
-            if (Wt::WDoubleValidator().validate(filledField.text()).state() != Wt::WValidator::Valid) {
-                return oldContent;
-            }
+    static bool parseNumber(const Wt::WString& text, int& value) {
+        Wt::WIntValidator validator;
+        validator.setMandatory(true);
+        if (validator.validate(text).state() != Wt::WValidator::Valid)
+            return false;
 
-            Wt::Dbo::Transaction transaction(*db);
-            Wt::Dbo::ptr<Ingredient> ingredient = db->find<Ingredient>().where("id = ?").bind(rowToID[row]);
-            ingredient.modify()->protein = std::stod(filledField.text());
-            return Wt::WString(filledField.text());
-        });
+        value = std::stoi(text.toUTF8());
+        return true;
+    }
 
-        // make salt editable
-        makeTextCellsInteractive(*ingredientList, colSalt, [&](int row, const Wt::WLineEdit& filledField, Wt::WString oldContent) {
-            if (Wt::WDoubleValidator().validate(filledField.text()).state() != Wt::WValidator::Valid) {
-                return oldContent;
-            }
+    static bool parseNumber(const Wt::WString& text, double& value) {
+        Wt::WDoubleValidator validator;
+        validator.setMandatory(true);
+        if (validator.validate(text).state() != Wt::WValidator::Valid)
+            return false;
 
-            Wt::Dbo::Transaction transaction(*db);
-            Wt::Dbo::ptr<Ingredient> ingredient = db->find<Ingredient>().where("id = ?").bind(rowToID[row]);
-            ingredient.modify()->salt = std::stod(filledField.text());
-            return Wt::WString(filledField.text());
-        });
+        value = std::stod(text.toUTF8());
+        return true;
+    }
 
-        // make ingredient price editable
-        if(db->users->find(db->login.user())->user()->accessLevel != 0)
-            makeTextCellsInteractive(*ingredientList, colPrice, [&](int row, const Wt::WLineEdit& filledField, Wt::WString oldContent) {
-                Wt::WDoubleValidator validator;
-                validator.setMandatory(true);
-                if (validator.validate(filledField.text()).state() != Wt::WValidator::Valid) {
-                    return oldContent.narrow();
+    template <typename Number>
+    Column numberColumn(const std::wstring& header, const std::string& orderBy, Number Ingredient::*field, bool editable) {
+        auto column = Column{header, [field](const IngredientRow& row) { return Wt::WString(std::to_string((*row.get<0>()).*field)); }, orderBy};
+        if (editable)
+            column.edit = [this, field](const IngredientRow& row, const boost::any& value) {
+                auto number = Number{};
+                if (!parseNumber(Wt::asString(value), number)) {
+                    return false;
                 }
 
-                Wt::Dbo::Transaction transaction(*db);
-                Wt::Dbo::ptr<Ingredient> ingredient = db->find<Ingredient>().where("id = ?").bind(rowToID[row]);
-                ingredient.modify()->price = std::stod(filledField.text());
-                return std::to_string(ingredient->price);
-            });
-
-        // make ingredient unit editable
-        auto unitKeys = std::make_shared<std::vector<Wt::Dbo::dbo_traits<Unit>::IdType>>();
-        makeCellsInteractive<Wt::WComboBox>(
-            *ingredientList, colUnit, [this, unitKeys](int row, Wt::WComboBox& editField) {
-                *unitKeys = populateComboBox<Unit>(*db, editField, [](const Unit& unit) { return unit.name; },
-                                           [this, row](Wt::Dbo::ptr<Unit> potentialUnit) {
-                                               auto transaction = Wt::Dbo::Transaction(*db);
-                                               auto ingredient = (Wt::Dbo::ptr<Ingredient>)db->find<Ingredient>().where("id = ?").bind(rowToID[row]);
-                                               return Unit::sameBranch(*db, potentialUnit.id(), ingredient->unitID);
-                                           });
-
-                auto oldContent = (Wt::WText*)ingredientList->elementAt(row, findColumn(*ingredientList, colUnit))->widget(0);
-                auto oldUnitName = oldContent->text();
-                auto indexOfOldUnit = editField.findText(oldUnitName);
-                editField.setCurrentIndex(indexOfOldUnit);
-            },
-            [this, unitKeys](int row, const Wt::WComboBox& filledEditField, Wt::WString) {
-                auto transaction = Wt::Dbo::Transaction(*db);
-
-                auto ingredient = (Wt::Dbo::ptr<Ingredient>)db->find<Ingredient>().where("id = ?").bind(rowToID[row]);
-                auto unit = (Wt::Dbo::ptr<Unit>)db->find<Unit>().where("id = ?").bind((*unitKeys)[filledEditField.currentIndex()]);
-                ingredient.modify()->unitID = unit.id();
+                changeIngredient(row.get<0>(), [field, number](Ingredient& ingredient) { ingredient.*field = number; });
+                return true;
+            };
 
-                return filledEditField.currentText();
-            });
+        return column;
     }
 
-    void setupDeleteAction() {
-        for (auto row = ingredientList->headerCount(); row < ingredientList->rowCount(); row++) {
-            auto column = findColumn(*ingredientList, colDelete);
-            if (column == -1)
-                return;
-
-            ingredientList->elementAt(row, column)->clicked().connect(std::bind([this, row] {
-                auto confirmationDialog = new Wt::WDialog(L"Potwierdzenie usunięcia składnika");
-                auto yesButton = new Wt::WPushButton("Tak", confirmationDialog->footer());
-                auto noButton = new Wt::WPushButton("Nie", confirmationDialog->footer());
-                new Wt::WText(L"Czy napewno usunąć składnik?", confirmationDialog->contents());
-                yesButton->clicked().connect(confirmationDialog, &Wt::WDialog::accept);
-                noButton->clicked().connect(confirmationDialog, &Wt::WDialog::reject);
-                confirmationDialog->rejectWhenEscapePressed();
-
-                confirmationDialog->finished().connect(std::bind([this, confirmationDialog, row] {
-                    if (confirmationDialog->result() != Wt::WDialog::Accepted)
-                        return;
+    void cellClicked(const Wt::WModelIndex& index) {
+        if (!index.isValid() || index.column() != model->columnOf(colDelete))
+            return;
 
-                    Wt::Dbo::Transaction transaction(*db);
+        auto id = model->idAt(index.row());
+        auto confirmationDialog = new Wt::WDialog(L"Potwierdzenie usunięcia składnika");
+        auto yesButton = new Wt::WPushButton("Tak", confirmationDialog->footer());
+        auto noButton = new Wt::WPushButton("Nie", confirmationDialog->footer());
+        new Wt::WText(L"Czy napewno usunąć składnik?", confirmationDialog->contents());
+        yesButton->clicked().connect(confirmationDialog, &Wt::WDialog::accept);
+        noButton->clicked().connect(confirmationDialog, &Wt::WDialog::reject);
+        confirmationDialog->rejectWhenEscapePressed();
 
-                    auto ingredient = (Wt::Dbo::ptr<Ingredient>)db->find<Ingredient>().where("id = ?").bind(rowToID[row]);
+        confirmationDialog->finished().connect(std::bind([this, confirmationDialog, id] {
+            if (confirmationDialog->result() == Wt::WDialog::Accepted)
+                deleteIngredient(id);
 
-                    auto recipes = (Wt::Dbo::collection<Wt::Dbo::ptr<Recipe>>)db->find<Recipe>();
-                    for (const auto& recipe : recipes) {
-                        for (const auto& ingredientRecord : recipe->ingredientRecords) {
-                            if (ingredientRecord->ingredientID == ingredient.id()) {
-                                auto dialog = new Wt::WDialog(L"Składnik jest używany");
-                                auto okButton = new Wt::WPushButton("OK", dialog->footer());
-                                okButton->clicked().connect(dialog, &Wt::WDialog::accept);
+            delete confirmationDialog;
+        }));
 
-                                auto message = Wt::WString(L"Składnik jest używany co najmniej w przepisie ") + recipe->name;
-                                message += L", więc nie może zostać usunięty.";
-                                new Wt::WText(std::move(message), dialog->contents());
+        confirmationDialog->show();
+    }
 
-                                dialog->finished().connect(std::bind([dialog] { delete dialog; }));
+    void deleteIngredient(Wt::Dbo::dbo_traits<Ingredient>::IdType id) {
+        Wt::Dbo::Transaction transaction(*db);
 
-                                dialog->show();
+        auto ingredient = (Wt::Dbo::ptr<Ingredient>)db->find<Ingredient>().where("id = ?").bind(id);
+        if (ingredient.id() == Wt::Dbo::dbo_traits<Ingredient>::invalidId()) {
+            showMessageDialog(L"Składnik nie istnieje", L"Składnik został w międzyczasie usunięty.");
+            return;
+        }
 
-                                return;
-                            }
-                        }
-                    }
+        auto recipes = References::recipesUsingIngredient(*db, ingredient.id());
+        if (!recipes.empty()) {
+            auto message = Wt::WString(L"Składnik jest używany co najmniej w przepisie ") + recipes.front();
+            message += L", więc nie może zostać usunięty.";
+            showMessageDialog(L"Składnik jest używany", message);
+            return;
+        }
 
-                    ingredient.remove();
-                    populateIngredientList();  // deleting screws up references to rows in lambdas inside, so rebuild table
-                    delete confirmationDialog;
-                }));
+        auto firmID = ingredient->ownerID;
+        ingredient.remove();
+        transaction.commit();
 
-                confirmationDialog->show();
-            }));
-        }
+        FirmCatalog::instance().removeIngredient(firmID, id);
+        publish(FirmChanges::Kind::Removed, id);
+        model->removeRecord(id);
     }
 };
@@ -0,0 +1,132 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <functional>
+
+// Server-wide metrics in the Prometheus text format, served by MetricsResource at /metrics.
+// Histograms have one label(e.g. statement or page), its values are capped so that made up values(e.g. internal paths) can't grow it forever.
+class Metrics {
+   public:
+    class Histogram {
+       public:
+        Histogram(std::string name, std::string help, std::string labelName, std::vector<double> buckets)
+            : name(std::move(name)), help(std::move(help)), labelName(std::move(labelName)), buckets(std::move(buckets)) {}
+
+        void observe(const std::string& label, double value) {
+            std::lock_guard<std::mutex> lock{mutex};
+            auto series = values.find(label);
+            if (series == values.end()) {
+                auto key = values.size() < maxLabels ? label : "other";
+                series = values.emplace(key, Series{std::vector<unsigned long long>(buckets.size(), 0)}).first;
+            }
+
+            for (auto i = 0u; i < buckets.size(); i++) {
+                if (value <= buckets[i])
+                    series->second.buckets[i]++;
+            }
+            series->second.sum += value;
+            series->second.count++;
+        }
+
+        void render(std::ostream& out) const {
+            std::lock_guard<std::mutex> lock{mutex};
+            out << "# HELP " << name << " " << help << "\n";
+            out << "# TYPE " << name << " histogram\n";
+            for (const auto& series : values) {
+                auto label = labelName + "=\"" + escape(series.first) + "\"";
+                for (auto i = 0u; i < buckets.size(); i++) {
+                    out << name << "_bucket{" << label << ",le=\"" << buckets[i] << "\"} " << series.second.buckets[i] << "\n";
+                }
+                out << name << "_bucket{" << label << ",le=\"+Inf\"} " << series.second.count << "\n";
+                out << name << "_sum{" << label << "} " << series.second.sum << "\n";
+                out << name << "_count{" << label << "} " << series.second.count << "\n";
+            }
+        }
+
+       private:
+        static constexpr std::size_t maxLabels = 500;
+
+        struct Series {
+            std::vector<unsigned long long> buckets;  // cumulative, like in the output
+            double sum = 0;
+            unsigned long long count = 0;
+        };
+
+        const std::string name;
+        const std::string help;
+        const std::string labelName;
+        const std::vector<double> buckets;
+
+        mutable std::mutex mutex;
+        std::map<std::string, Series> values;
+    };
+
+    static Metrics& instance() {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    // registered once(e.g. from a function-local static), lives as long as the server
+    Histogram& histogram(const std::string& name, const std::string& help, const std::string& labelName, const std::vector<double>& buckets) {
+        std::lock_guard<std::mutex> lock{mutex};
+        histograms.push_back(std::make_unique<Histogram>(name, help, labelName, buckets));
+        return *histograms.back();
+    }
+
+    // value is read while rendering, so whatever read uses has to outlive the server(e.g. ConnectionPool in main)
+    void gauge(const std::string& name, const std::string& help, std::function<double()> read) {
+        std::lock_guard<std::mutex> lock{mutex};
+        gauges.push_back(Gauge{name, help, "gauge", std::move(read)});
+    }
+
+    // same as gauge, for values which only grow(e.g. cache hits)
+    void counter(const std::string& name, const std::string& help, std::function<double()> read) {
+        std::lock_guard<std::mutex> lock{mutex};
+        gauges.push_back(Gauge{name, help, "counter", std::move(read)});
+    }
+
+    std::string render() const {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto out = std::ostringstream{};
+        for (const auto& gauge : gauges) {
+            out << "# HELP " << gauge.name << " " << gauge.help << "\n";
+            out << "# TYPE " << gauge.name << " " << gauge.type << "\n";
+            out << gauge.name << " " << gauge.read() << "\n";
+        }
+
+        for (const auto& histogram : histograms) {
+            histogram->render(out);
+        }
+
+        return out.str();
+    }
+
+   private:
+    struct Gauge {
+        std::string name;
+        std::string help;
+        std::string type;
+        std::function<double()> read;
+    };
+
+    Metrics() = default;
+
+    static std::string escape(const std::string& value) {
+        auto escaped = std::string{};
+        for (auto c : value) {
+            if (c == '\\' || c == '"')
+                escaped += '\\';
+            escaped += c == '\n' ? std::string{"\\n"} : std::string(1, c);
+        }
+
+        return escaped;
+    }
+
+    mutable std::mutex mutex;
+    std::vector<Gauge> gauges;
+    std::vector<std::unique_ptr<Histogram>> histograms;
+};
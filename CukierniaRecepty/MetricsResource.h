@@ -0,0 +1,19 @@
+#pragma once
+#include <Wt/WResource>
+#include <Wt/Http/Request>
+#include <Wt/Http/Response>
+#include "Metrics.h"
+
+// Metrics in the Prometheus text format, deployed by main() at /metrics. Not behind the login, so the path should only be reachable
+// from the monitoring network(e.g. blocked at the reverse proxy).
+class MetricsResource : public Wt::WResource {
+   public:
+    ~MetricsResource() override {
+        beingDeleted();
+    }
+
+    void handleRequest(const Wt::Http::Request&, Wt::Http::Response& response) override {
+        response.setMimeType("text/plain; version=0.0.4");
+        response.out() << Metrics::instance().render();
+    }
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+// All numeric values of an ingredient(price and nutrition facts), so that they can be scaled and summed in one pass.
+// Invalid vector(e.g. ingredient of a record doesn't exist anymore) has all values set to -1, see IngredientRecord::scaled and Recipe::totals.
+struct NutritionVector {
+    double price = 0.0;
+    double kcal = 0.0;
+    double fat = 0.0;
+    double saturatedAcids = 0.0;
+    double carbohydrates = 0.0;
+    double sugar = 0.0;
+    double protein = 0.0;
+    double salt = 0.0;
+    bool valid = true;
+
+    static NutritionVector invalid() {
+        auto result = NutritionVector{};
+        result.price = result.kcal = result.fat = result.saturatedAcids = -1;
+        result.carbohydrates = result.sugar = result.protein = result.salt = -1;
+        result.valid = false;
+        return result;
+    }
+
+    NutritionVector& operator+=(const NutritionVector& other) {
+        if (!valid || !other.valid) {
+            return *this = invalid();
+        }
+
+        price += other.price;
+        kcal += other.kcal;
+        fat += other.fat;
+        saturatedAcids += other.saturatedAcids;
+        carbohydrates += other.carbohydrates;
+        sugar += other.sugar;
+        protein += other.protein;
+        salt += other.salt;
+        return *this;
+    }
+
+    NutritionVector operator*(double factor) const {
+        if (!valid) {
+            return invalid();
+        }
+
+        auto result = *this;
+        result.price *= factor;
+        result.kcal *= factor;
+        result.fat *= factor;
+        result.saturatedAcids *= factor;
+        result.carbohydrates *= factor;
+        result.sugar *= factor;
+        result.protein *= factor;
+        result.salt *= factor;
+        return result;
+    }
+};
@@ -0,0 +1,160 @@
+#pragma once
+#include <deque>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include <Wt/WServer>
+#include <Wt/WLogger>
+#include <Wt/WApplication>
+#include "Metrics.h"
+
+// Login settings, read from <properties> of wt_config.xml.
+struct AuthConfig {
+    int bcryptCost = 7;  // changing it rehashes passwords of users as they log in
+    int hashingThreads = 2;
+    int hashingQueue = 64;  // checks waiting for a thread, more are refused(user is asked to try again)
+    int resumeCacheSeconds = 300;  // how long TokenCache trusts a validated auth token, 0 turns it off
+    int resumeCacheSize = 10000;
+
+    static AuthConfig fromServer(const Wt::WServer& server) {
+        auto config = AuthConfig{};
+        readProperty(server, "auth-bcrypt-cost", config.bcryptCost);
+        readProperty(server, "auth-hashing-threads", config.hashingThreads);
+        readProperty(server, "auth-hashing-queue", config.hashingQueue);
+        readProperty(server, "auth-resume-cache-seconds", config.resumeCacheSeconds);
+        readProperty(server, "auth-resume-cache-size", config.resumeCacheSize);
+        return config;
+    }
+
+   private:
+    static void readProperty(const Wt::WServer& server, const std::string& name, int& value) {
+        auto text = std::string{};
+        if (!server.readConfigurationProperty(name, text)) {
+            return;
+        }
+
+        try {
+            value = std::stoi(text);
+        } catch (const std::exception&) {
+            Wt::log("error") << "AuthConfig: property " << name << " is not a number(\"" << text << "\"), using " << value;
+        }
+    }
+};
+
+// Threads which compute password hashes(bcrypt takes tens of milliseconds on purpose), so that session threads aren't blocked by them
+// and logins of many users at once don't freeze other sessions. Work gets no Dbo session, it has to be given everything it needs.
+class PasswordHashing {
+   public:
+    // runs on a hashing thread, returns what has to be done with the result in the session
+    using Work = std::function<std::function<void()>()>;
+
+    static PasswordHashing& instance() {
+        static PasswordHashing hashing;
+        return hashing;
+    }
+
+    void start(const AuthConfig& config) {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (!threads.empty())
+            return;
+
+        maxQueued = static_cast<std::size_t>(std::max(config.hashingQueue, 1));
+        for (auto i = 0; i < std::max(config.hashingThreads, 1); i++) {
+            threads.emplace_back([this] { run(); });
+        }
+
+        auto& metrics = Metrics::instance();
+        metrics.gauge("bakery_password_hashing_queued", "Password checks waiting for a hashing thread.", [this] { return queueDepth(); });
+        metrics.gauge("bakery_password_hashing_running", "Password checks being computed.", [this] { return runningJobs(); });
+    }
+
+    // has to be called from a session, the result is posted to it(WServer::post); false if the queue is full
+    bool submit(Work work) {
+        auto job = Job{Wt::WApplication::instance()->sessionId(), std::move(work)};
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            if (threads.empty() || queue.size() >= maxQueued)
+                return false;
+
+            queue.push_back(std::move(job));
+        }
+
+        jobAvailable.notify_one();
+        return true;
+    }
+
+    ~PasswordHashing() {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+        }
+        jobAvailable.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+   private:
+    struct Job {
+        std::string sessionID;
+        Work work;
+    };
+
+    PasswordHashing() = default;
+
+    double queueDepth() const {
+        std::lock_guard<std::mutex> lock{mutex};
+        return static_cast<double>(queue.size());
+    }
+
+    double runningJobs() const {
+        std::lock_guard<std::mutex> lock{mutex};
+        return running;
+    }
+
+    void run() {
+        while (true) {
+            auto job = Job{};
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                jobAvailable.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (stopping)
+                    return;
+
+                job = std::move(queue.front());
+                queue.pop_front();
+                running++;
+            }
+
+            auto done = std::function<void()>{};
+            try {
+                done = job.work();
+            } catch (const std::exception& e) {
+                Wt::log("error") << "PasswordHashing: " << e.what();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                running--;
+            }
+
+            // session may be gone already, then post does nothing
+            auto server = Wt::WServer::instance();
+            if (done && server)
+                server->post(job.sessionID, std::move(done));
+        }
+    }
+
+    mutable std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::deque<Job> queue;
+    std::vector<std::thread> threads;
+    std::size_t maxQueued = 0;
+    int running = 0;
+    bool stopping = false;
+};
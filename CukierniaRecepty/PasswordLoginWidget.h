@@ -0,0 +1,144 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <string>
+#include <Wt/WLineEdit>
+#include <Wt/WPushButton>
+#include <Wt/WApplication>
+#include <Wt/WValidator>
+#include <Wt/Auth/AuthWidget>
+#include <Wt/Auth/AuthModel>
+#include <Wt/Auth/Identity>
+#include <Wt/Auth/PasswordHash>
+#include <Wt/Auth/User>
+#include "database.h"
+#include "Metrics.h"
+#include "PasswordHashing.h"
+
+// AuthWidget whose password login doesn't block the session thread: the password is checked by PasswordHashing and the login
+// finishes when the result is posted back to the session. Passwords hashed with other settings(e.g. an old bcrypt cost) are
+// hashed again after a successful login, also on a hashing thread.
+class PasswordLoginWidget : public Wt::Auth::AuthWidget {
+   public:
+    explicit PasswordLoginWidget(Database& db) : AuthWidget(Database::auth(), *db.users, db.login), db(db) {}
+
+   protected:
+    Wt::WFormWidget* createFormWidget(Wt::WFormModel::Field field) override {
+        if (field != Wt::Auth::AuthModel::PasswordField)
+            return AuthWidget::createFormWidget(field);
+
+        auto password = new Wt::WLineEdit();
+        password->setEchoMode(Wt::WLineEdit::Password);
+        password->enterPressed().connect(this, &PasswordLoginWidget::attemptLogin);
+        return password;
+    }
+
+    // button of AuthWidget would check the password right in the handler, so it's replaced
+    void createPasswordLoginView() override {
+        AuthWidget::createPasswordLoginView();
+        loginButton = new Wt::WPushButton(tr("Wt.Auth.login"));
+        bindWidget("login", loginButton);
+        loginButton->clicked().connect(this, &PasswordLoginWidget::attemptLogin);
+        model()->configureThrottling(loginButton);
+    }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    static Metrics::Histogram& loginSeconds() {
+        static auto& histogram = Metrics::instance().histogram("bakery_login_seconds", "Time from submitting the login form to its result, waiting for a hashing thread included.",
+                                                               "outcome", {0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10});
+        return histogram;
+    }
+
+    void attemptLogin() {
+        if (pending)
+            return;
+
+        updateModel(model());
+        auto started = Clock::now();
+        auto loginName = model()->valueText(Wt::Auth::AuthModel::LoginNameField);
+        auto password = model()->valueText(Wt::Auth::AuthModel::PasswordField);
+
+        auto userID = std::string{};
+        auto hash = Wt::Auth::PasswordHash{};
+        {
+            Wt::Dbo::Transaction transaction{db};
+            auto user = model()->users().findWithIdentity(Wt::Auth::Identity::LoginName, loginName);
+            if (!user.isValid()) {
+                fail(started, "invalid", Wt::Auth::AuthModel::LoginNameField, tr("Wt.Auth.user-name-invalid"));
+                return;
+            }
+
+            // throttling is counted by User::setAuthenticated, same as in PasswordService::verifyPassword
+            auto delay = Database::passwordAuth().delayForNextAttempt(user);
+            if (delay > 0) {
+                fail(started, "throttled", Wt::Auth::AuthModel::PasswordField, tr("Wt.Auth.throttle-retry").arg(delay));
+                return;
+            }
+
+            userID = user.id();
+            hash = user.password();
+        }
+
+        // only values are passed to the hashing thread, this widget may be gone when it's done
+        auto alive = std::weak_ptr<int>{guard};
+        auto submitted = PasswordHashing::instance().submit([this, alive, userID, password, hash, started]() -> std::function<void()> {
+            const auto& verifier = *Database::passwordAuth().verifier();
+            auto valid = verifier.verify(password, hash);
+            auto rehashed = valid && Database::needsRehash(hash) ? verifier.hashPassword(password) : Wt::Auth::PasswordHash{};
+
+            return [this, alive, userID, valid, rehashed, started] {
+                if (alive.lock())
+                    finishLogin(userID, valid, rehashed, started);
+            };
+        });
+
+        if (!submitted) {
+            fail(started, "busy", Wt::Auth::AuthModel::PasswordField, Wt::WString(L"Serwer jest zajęty, spróbuj zalogować się ponownie za chwilę"));
+            return;
+        }
+
+        pending = true;
+        loginButton->disable();
+    }
+
+    // runs in the session, posted by PasswordHashing
+    void finishLogin(const std::string& userID, bool valid, const Wt::Auth::PasswordHash& rehashed, Clock::time_point started) {
+        pending = false;
+        loginButton->enable();
+
+        auto user = Wt::Auth::User{};
+        {
+            Wt::Dbo::Transaction transaction{db};
+            user = model()->users().findWithId(userID);
+            if (user.isValid()) {
+                user.setAuthenticated(valid);
+                if (valid && !rehashed.value().empty())
+                    user.setPassword(rehashed);
+            }
+        }
+
+        if (!user.isValid() || !valid) {
+            fail(started, "invalid", Wt::Auth::AuthModel::PasswordField, tr("Wt.Auth.password-invalid"));
+        } else {
+            loginSeconds().observe("success", std::chrono::duration<double>(Clock::now() - started).count());
+            model()->loginUser(login(), user);  // also sets the remember-me cookie if it was checked
+            updateView(model());
+        }
+
+        Wt::WApplication::instance()->triggerUpdate();
+    }
+
+    void fail(Clock::time_point started, const std::string& outcome, Wt::WFormModel::Field field, const Wt::WString& message) {
+        loginSeconds().observe(outcome, std::chrono::duration<double>(Clock::now() - started).count());
+        model()->setValidation(field, Wt::WValidator::Result(Wt::WValidator::Invalid, message));
+        model()->updateThrottling(loginButton);  // as AuthWidget does after a failed attempt
+        updateView(model());
+    }
+
+    Database& db;
+    Wt::WPushButton* loginButton = nullptr;
+    bool pending = false;  // password is being checked
+    std::shared_ptr<int> guard = std::make_shared<int>(0);  // posted results check it before touching the widget
+};
@@ -0,0 +1,247 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+#include <boost/any.hpp>
+#include <boost/optional.hpp>
+#include <Wt/WAbstractTableModel>
+#include <Wt/WModelIndex>
+#include <Wt/WString>
+
+// Table model which loads rows from the database a page at a time, only when a view asks for them.
+// Sorting is done by the database, using order by expression of the column.
+// Rows are identified by their database id, so edits and deletions patch only the affected rows.
+template <class Row>
+class QueryTableModel : public Wt::WAbstractTableModel {
+   public:
+    using IdType = long long;
+
+    struct Column {
+        std::wstring header;
+        std::function<Wt::WString(const Row&)> display;
+        std::string orderBy;  // empty if column can't be sorted
+        std::function<bool(const Row&, const boost::any&)> edit = nullptr;  // empty if column can't be edited, returns false if value was rejected
+    };
+
+    // returns at most limit rows starting at offset, in given order
+    using Fetch = std::function<std::vector<Row>(int offset, int limit, const std::string& orderBy)>;
+    // current state of a single row, none if it doesn't exist anymore
+    using FetchOne = std::function<boost::optional<Row>(IdType id)>;
+    using Count = std::function<int()>;
+    using Identify = std::function<IdType(const Row&)>;
+
+    QueryTableModel(std::vector<Column> columns, Count count, Fetch fetch, FetchOne fetchOne, Identify identify, std::string defaultOrder, int pageSize = 50)
+        : columns(std::move(columns)), count(std::move(count)), fetch(std::move(fetch)), fetchOne(std::move(fetchOne)), identify(std::move(identify)),
+          orderBy(std::move(defaultOrder)), pageSize(pageSize) {
+        rows = this->count();
+    }
+
+    int rowCount(const Wt::WModelIndex& parent = Wt::WModelIndex()) const override {
+        return parent.isValid() ? 0 : rows;
+    }
+
+    int columnCount(const Wt::WModelIndex& parent = Wt::WModelIndex()) const override {
+        return parent.isValid() ? 0 : static_cast<int>(columns.size());
+    }
+
+    boost::any data(const Wt::WModelIndex& index, int role = Wt::DisplayRole) const override {
+        if (role != Wt::DisplayRole && role != Wt::EditRole) {
+            return boost::any();
+        }
+
+        auto row = rowAt(index.row());
+        if (!row) {
+            return boost::any();
+        }
+
+        return boost::any(columns[index.column()].display(*row));
+    }
+
+    boost::any headerData(int section, Wt::Orientation orientation = Wt::Horizontal, int role = Wt::DisplayRole) const override {
+        if (orientation != Wt::Horizontal || role != Wt::DisplayRole) {
+            return boost::any();
+        }
+
+        return boost::any(Wt::WString(columns[section].header));
+    }
+
+    Wt::WFlags<Wt::ItemFlag> flags(const Wt::WModelIndex& index) const override {
+        auto result = Wt::WFlags<Wt::ItemFlag>(Wt::ItemIsSelectable);
+        if (columns[index.column()].edit) {
+            result |= Wt::ItemIsEditable;
+        }
+
+        return result;
+    }
+
+    bool setData(const Wt::WModelIndex& index, const boost::any& value, int role = Wt::EditRole) override {
+        auto row = rowAt(index.row());
+        if (role != Wt::EditRole || !row || !columns[index.column()].edit) {
+            return false;
+        }
+
+        if (!columns[index.column()].edit(*row, value)) {
+            return false;
+        }
+
+        refreshRow(index.row());
+        return true;
+    }
+
+    void sort(int column, Wt::SortOrder order = Wt::AscendingOrder) override {
+        if (columns[column].orderBy.empty()) {
+            return;
+        }
+
+        layoutAboutToBeChanged().emit();
+        orderBy = columns[column].orderBy + (order == Wt::AscendingOrder ? " asc" : " desc");
+        cache.clear();
+        layoutChanged().emit();
+    }
+
+    // -1 if there's no such column
+    int columnOf(const std::wstring& header) const {
+        for (auto i = 0u; i < columns.size(); i++) {
+            if (columns[i].header == header) {
+                return static_cast<int>(i);
+            }
+        }
+
+        return -1;
+    }
+
+    IdType idAt(int row) const {
+        auto element = rowAt(row);
+        return element ? identify(*element) : -1;
+    }
+
+    // rereads rows(only those loaded so far) which satisfy the predicate, e.g. rows showing name of a renamed record
+    void refreshRows(std::function<bool(const Row&)> predicate) {
+        auto affected = std::vector<int>{};
+        for (const auto& entry : cache) {
+            if (predicate(entry.second)) {
+                affected.push_back(entry.first);
+            }
+        }
+
+        for (auto row : affected) {
+            refreshRow(row);
+        }
+    }
+
+    // rereads row of the record, if it's loaded
+    void refreshRecord(IdType id) {
+        auto row = cachedRowOf(id);
+        if (row != -1) {
+            refreshRow(row);
+        }
+    }
+
+    // drops loaded rows but keeps the row count, e.g. after a change which may affect any row(views ask again only for visible rows)
+    void refreshAll() {
+        cache.clear();
+        if (rows > 0) {
+            dataChanged().emit(index(0, 0), index(rows - 1, columnCount() - 1));
+        }
+    }
+
+    // removes row of the record, if it was deleted outside of the model
+    void removeRecord(IdType id) {
+        auto row = cachedRowOf(id);
+        if (row == -1) {
+            reload();
+            return;
+        }
+
+        beginRemoveRows(Wt::WModelIndex(), row, row);
+        eraseFromCache(row);
+        rows--;
+        endRemoveRows();
+    }
+
+    // drops everything loaded so far, to be called after rows were added(their position depends on sorting) or changed in bulk outside of the model
+    void reload() {
+        cache.clear();
+        rows = count();
+        reset();
+    }
+
+   private:
+    const Row* rowAt(int row) const {
+        if (row < 0 || row >= rows) {
+            return nullptr;
+        }
+
+        auto element = cache.find(row);
+        if (element == cache.end()) {
+            // views ask only for what is visible, so a handful of pages is plenty
+            if (cache.size() >= maxCachedRows) {
+                cache.clear();
+            }
+
+            auto first = row - row % pageSize;
+            auto fetched = fetch(first, pageSize, orderBy);
+            for (auto i = 0u; i < fetched.size(); i++) {
+                cache.emplace(first + static_cast<int>(i), std::move(fetched[i]));
+            }
+
+            element = cache.find(row);
+        }
+
+        return element != cache.end() ? &element->second : nullptr;
+    }
+
+    // -1 if it isn't loaded
+    int cachedRowOf(IdType id) const {
+        for (const auto& entry : cache) {
+            if (identify(entry.second) == id) {
+                return entry.first;
+            }
+        }
+
+        return -1;
+    }
+
+    void refreshRow(int row) {
+        auto element = cache.find(row);
+        if (element == cache.end()) {
+            return;
+        }
+
+        auto current = fetchOne(identify(element->second));
+        if (!current) {
+            beginRemoveRows(Wt::WModelIndex(), row, row);
+            eraseFromCache(row);
+            rows--;
+            endRemoveRows();
+            return;
+        }
+
+        element->second = std::move(*current);
+        dataChanged().emit(index(row, 0), index(row, columnCount() - 1));
+    }
+
+    // rows below the erased one move up, so that they keep matching offsets in the database
+    void eraseFromCache(int row) {
+        auto shifted = std::map<int, Row>{};
+        for (auto& entry : cache) {
+            if (entry.first != row) {
+                shifted.emplace(entry.first < row ? entry.first : entry.first - 1, std::move(entry.second));
+            }
+        }
+
+        cache = std::move(shifted);
+    }
+
+    std::vector<Column> columns;
+    Count count;
+    Fetch fetch;
+    FetchOne fetchOne;
+    Identify identify;
+    std::string orderBy;
+    int pageSize;
+    std::size_t maxCachedRows = 8 * static_cast<std::size_t>(pageSize);
+    int rows = 0;
+    mutable std::map<int, Row> cache;
+};
@@ -3,6 +3,10 @@
 #include <Wt/Dbo/Dbo>
 #include "Unit.h"
 #include "Ingredient.h"
+#include "FirmCatalog.h"
+#include "NutritionVector.h"
+#include "SchemaIndex.h"
+#include "Tracing.h"
 
 class Recipe;
 
@@ -21,25 +25,21 @@ class IngredientRecord {
         Wt::Dbo::belongsTo(action, recipe, "recipe");
     }
 
-	double scaledIngredientValue(Database& db, std::function<double(const Ingredient&)> value) const {
-        Wt::Dbo::ptr<Ingredient> ingredient = db.find<Ingredient>().where("id = ?").bind(this->ingredientID);
-        if (ingredient.id() == Wt::Dbo::dbo_traits<Ingredient>::invalidId()) {
-            return -1;
-        }
-
-        auto ingredientRecordQuantityInBaseUnits = 1.0;
-        auto ingredientRecordUnitPath = Unit::pathToTheRoot(db, this->unitID);
-        for (const auto& unit : ingredientRecordUnitPath) {
-            ingredientRecordQuantityInBaseUnits *= unit->quantity;
-        }
+    static std::vector<SchemaIndex> indexes() {
+        return {{"ingredient_record_recipe", {"recipe_id"}, true},
+                {"ingredient_record_ingredient", {"ingredient_id"}},
+                {"ingredient_record_unit", {"unit_id"}}};
+    }
 
-        auto ingredientQuantityInBaseUnits = 1.0;
-        auto ingredientUnitPath = Unit::pathToTheRoot(db, ingredient->unitID);
-        for (const auto& unit : ingredientUnitPath) {
-            ingredientQuantityInBaseUnits *= unit->quantity;
+    // all values of the ingredient scaled to the quantity of this record; catalog is the one of the firm owning the recipe
+    NutritionVector scaled(const FirmCatalog::Snapshot& catalog) const {
+        auto ingredient = catalog.ingredient(this->ingredientID);
+        if (!ingredient) {
+            return NutritionVector::invalid();
         }
 
-        return value(*ingredient) / ingredientQuantityInBaseUnits * ingredientRecordQuantityInBaseUnits * this->quantity;
+        const auto& conversions = catalog.conversions;
+        return ingredient->values() * (conversions.factor(this->unitID) / conversions.factor(ingredient->unitID) * this->quantity);
     }
 };
 
@@ -56,18 +56,22 @@ class Recipe {
         Wt::Dbo::hasMany(action, ingredientRecords, Wt::Dbo::ManyToOne, "recipe");
     }
 
-    //-1 in the case of error, otherwise sum of chosen scaled ingredient values
-    double totalIngredientValue(Database& db, std::function<double(const Ingredient&)> value) const {
+    static std::vector<SchemaIndex> indexes() {
+        return {{"recipe_owner_name", {"owner_id", "name(64)"}}};
+    }
+
+    // every total of the recipe computed in a single traversal of its ingredient records
+    NutritionVector totals(Database& db) const {
+        Tracing::Span span{"Recipe::totals"};
+        auto catalog = FirmCatalog::instance().snapshot(db, ownerID);
         auto transaction = Wt::Dbo::Transaction{db};
 
-        auto result = 0.0;
+        auto result = NutritionVector{};
         for (const auto& ingredientRecord : ingredientRecords) {
-            auto sum  = ingredientRecord->scaledIngredientValue(db, [&](const Ingredient& i) { return value(i); });
-            if (sum == -1) {
-                return -1;
+            result += ingredientRecord->scaled(*catalog);
+            if (!result.valid) {
+                break;
             }
-
-            result += sum;
         }
 
         return result;
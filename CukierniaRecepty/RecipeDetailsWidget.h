@@ -1,7 +1,7 @@
 #pragma once
 #include <vector>
+#include <algorithm>
 #include <memory>
-#include <unordered_map>
 #include <Wt/Dbo/Session>
 #include <Wt/WLineEdit>
 #include <Wt/WDialog>
@@ -11,29 +11,41 @@
 #include "Ingredient.h"
 #include "Unit.h"
 #include "Recipe.h"
+#include "FirmCatalog.h"
+#include "FirmChanges.h"
+#include "RecipeTotals.h"
+#include "Tracing.h"
 
 class RecipeDetailsWidget : public Wt::WContainerWidget {
-    const std::wstring colIngredient = L"Składnik";
-    const std::wstring colQuantity = L"Ilość";
-    const std::wstring colUnit = L"Jednostka";
-    const std::wstring colKcal = L"Kaloryczność";
-    const std::wstring colFats = L"Tłuszcze";
-    const std::wstring colSatAcids = L"Kwasy nasycone";
-    const std::wstring colCarbs = L"Węglowodany";
-    const std::wstring colSugar = L"Cukry";
-    const std::wstring colProtein = L"Białka";
-    const std::wstring colSalt = L"Sól";
-    const std::wstring colCost = L"Koszt";
-    const std::wstring colDelete = L"Usuń";
+    enum Column { colIngredient, colQuantity, colUnit, colKcal, colFats, colSatAcids, colCarbs, colSugar, colProtein, colSalt, colCost, colDelete };
    public:
     RecipeDetailsWidget(Wt::WContainerWidget*, Database& db) : db(&db) {
-        if(db.users->find(db.login.user())->user()->accessLevel != 0) {
+        if(db.currentUser().canEdit()) {
             addButton = std::make_unique<Wt::WPushButton>(L"Dodaj składnik", this);
             addButton->clicked().connect(this, &RecipeDetailsWidget::showAddDialog);
         }
 
+        std::vector<TableSchema::Column> columns = {{colIngredient, L"Składnik"}, {colUnit, L"Jednostka"}, {colQuantity, L"Ilość"}};
+        if(db.currentUser().canEdit())
+            columns.push_back({colCost, L"Koszt"});
+
+        columns.insert(columns.end(), {{colKcal, L"Kaloryczność"}, {colFats, L"Tłuszcze"}, {colSatAcids, L"Kwasy nasycone"}, {colCarbs, L"Węglowodany"},
+                                       {colSugar, L"Cukry"}, {colProtein, L"Białka"}, {colSalt, L"Sól"}});
+        if(db.currentUser().canEdit())
+            columns.push_back({colDelete, L"Usuń"});
+
+        schema = TableSchema{std::move(columns)};
+
         ingredientList = std::make_unique<Wt::WTable>(this);
         ingredientList->addStyleClass("table table-stripped table-bordered");
+        ingredientClicks = std::make_unique<TableClicks>(*ingredientList);
+
+        if(db.currentUser().canEdit()) {
+            makeTableEditable();
+            setupDeleteAction();
+        }
+
+        changes = FirmChanges::instance().subscribe(db.currentUser().firmID, [this](const FirmChanges::Change& change) { applyChange(change); });
     }
 
     void setRecipe(Wt::Dbo::dbo_traits<Recipe>::IdType recipeID) {
@@ -42,31 +54,48 @@ class RecipeDetailsWidget : public Wt::WContainerWidget {
     }
 
     void populateIngredientList() {
+        Tracing::Span span{"RecipeDetailsWidget::populateIngredientList"};
         if (currentRecipe == Wt::Dbo::dbo_traits<Recipe>::invalidId()) {
             return;
         }
 
         populateIngredientTable();
-
-        if(db->users->find(db->login.user())->user()->accessLevel != 0) {
-            makeTableEditable();
-            setupDeleteAction();
-        }
     }
 
     Wt::Dbo::dbo_traits<Recipe>::IdType currentRecipe = Wt::Dbo::dbo_traits<Recipe>::invalidId();
    private:
     Database* db;
+    TableSchema schema;
     std::unique_ptr<Wt::WTable> ingredientList;
-    std::unordered_map<int, Wt::Dbo::dbo_traits<IngredientRecord>::IdType> rowToID;
+    std::unique_ptr<TableClicks> ingredientClicks;
+    std::vector<Wt::Dbo::dbo_traits<IngredientRecord>::IdType> recordIDs;  // in order of table rows below the header
     std::unique_ptr<Wt::WPushButton> addButton;
+    FirmChanges::Subscription changes;
+
+    FirmCatalog::SnapshotPtr catalog() {
+        return FirmCatalog::instance().snapshot(*db, db->currentUser().firmID);
+    }
+
+    Wt::Dbo::dbo_traits<IngredientRecord>::IdType recordAt(int row) {
+        return recordIDs[row - ingredientList->headerCount()];
+    }
+
+    // -1 if the record isn't shown
+    int rowOf(Wt::Dbo::dbo_traits<IngredientRecord>::IdType recordID) {
+        for (auto i = 0u; i < recordIDs.size(); i++) {
+            if (recordIDs[i] == recordID)
+                return ingredientList->headerCount() + static_cast<int>(i);
+        }
+
+        return -1;
+    }
 
     void showAddDialog() {
         Wt::WDialog* dialog = new Wt::WDialog(L"Dodaj składnik");
+        auto firmCatalog = catalog();
 
         auto nameField = createLabeledField<Wt::WComboBox>(L"Składnik", dialog->contents());
-        auto ingredientIDs = populateComboBox<Ingredient>(*db, *nameField, [](const Ingredient& elem) { return elem.name; },
-            [this](const Wt::Dbo::ptr<Ingredient>& elem) { return elem->ownerID == db->users->find(db->login.user())->user()->firmID; });
+        auto ingredientIDs = populateComboBox(*nameField, firmCatalog->ingredients);
 
         auto quantityField = createLabeledField<Wt::WLineEdit>(L"Ilość", dialog->contents());
 
@@ -74,15 +103,12 @@ class RecipeDetailsWidget : public Wt::WContainerWidget {
         auto unitIDs = std::make_shared<std::vector<Wt::Dbo::dbo_traits<Unit>::IdType>>();
 
         nameField->changed().connect(std::bind([=] {
-            auto ingredientID = ingredientIDs[nameField->currentIndex()];
+            auto ingredient = firmCatalog->ingredient(ingredientIDs[nameField->currentIndex()]);
 
             unitField->clear();
-            *unitIDs = populateComboBox<Unit>(*db, *unitField, [](const Unit& unit) { return unit.name; },
-                                              [this, ingredientID](Wt::Dbo::ptr<Unit> potentialUnit) {
-                                                  auto transaction = Wt::Dbo::Transaction(*db);
-                                                  auto ingredient = (Wt::Dbo::ptr<Ingredient>)db->find<Ingredient>().where("id = ?").bind(ingredientID);
-                                                  return Unit::sameBranch(*db, potentialUnit.id(), ingredient->unitID);
-                                              });
+            *unitIDs = populateComboBox(*unitField, firmCatalog->units, [&](Wt::Dbo::dbo_traits<Unit>::IdType unitID, const Unit&) {
+                return Unit::sameBranch(firmCatalog->conversions, unitID, ingredient->unitID);
+            });
         }));
 
         nameField->changed().emit();
@@ -116,8 +142,20 @@ class RecipeDetailsWidget : public Wt::WContainerWidget {
                 ingredientRecord->quantity = std::stod(quantityField->text());
                 ingredientRecord->unitID = (*unitIDs)[unitField->currentIndex()];
                 ingredientRecord->recipe = (Wt::Dbo::ptr<Recipe>)db->find<Recipe>().where("id = ?").bind(currentRecipe);
-                db->add<IngredientRecord>(ingredientRecord);
-                populateIngredientList();
+                if (ingredientRecord->recipe.id() == Wt::Dbo::dbo_traits<Recipe>::invalidId()) {
+                    delete ingredientRecord;
+                    showMessageDialog(L"Przepis nie istnieje", L"Przepis został w międzyczasie usunięty.");
+                    delete dialog;
+                    return;
+                }
+
+                auto added = db->add<IngredientRecord>(ingredientRecord);
+                db->flush();
+                RecipeTotals::recipeChanged(*db, db->currentUser().firmID, currentRecipe);
+                transaction.commit();
+
+                appendRecord(added);
+                publishRecordChange(FirmChanges::Kind::Added, added.id());
             }
 
             delete dialog;
@@ -126,139 +164,182 @@ class RecipeDetailsWidget : public Wt::WContainerWidget {
         dialog->show();
     }
 
-    void updateColumn(const std::wstring& colName, int row, const Wt::WString& newContent) {
-        for(auto i = 0; i < ingredientList->columnCount(); i++) {
-            auto currColName = ((Wt::WText*)ingredientList->elementAt(0, i)->widget(0))->text();
-            if (currColName == colName) {
-                auto elem = (Wt::WText*)ingredientList->elementAt(row, i)->widget(0);
-                elem->setText(newContent);
-                return;
-            }
-        }
+    void updateCell(Column key, int row, const Wt::WString& newContent) {
+        auto column = schema.column(key);
+        if (column == -1)
+            return;
+
+        auto elem = (Wt::WText*)ingredientList->elementAt(row, column)->widget(0);
+        elem->setText(newContent);
+    }
+
+    void updateValueColumns(int row, const NutritionVector& values) {
+        updateCell(colCost, row, !values.valid ? L"Błąd, nie można obliczyć kosztu" : std::to_wstring(values.price));
+        updateCell(colKcal, row, std::to_wstring(values.kcal));
+        updateCell(colFats, row, std::to_wstring(values.fat));
+        updateCell(colSatAcids, row, std::to_wstring(values.saturatedAcids));
+        updateCell(colCarbs, row, std::to_wstring(values.carbohydrates));
+        updateCell(colSugar, row, std::to_wstring(values.sugar));
+        updateCell(colProtein, row, std::to_wstring(values.protein));
+        updateCell(colSalt, row, std::to_wstring(values.salt));
+    }
+
+    void fillRecordRow(const FirmCatalog::Snapshot& firmCatalog, const Wt::Dbo::ptr<IngredientRecord>& ingredientRecord, TableRow& cells) {
+        auto unit = firmCatalog.unit(ingredientRecord->unitID);
+        auto unitName = unit ? unit->name : Wt::WString(L"Błędna jednostka");
+
+        auto ingredient = firmCatalog.ingredient(ingredientRecord->ingredientID);
+        auto ingredientName = ingredient ? ingredient->name : Wt::WString(L"Błędny skladnik");
+
+        auto values = ingredientRecord->scaled(firmCatalog);
+
+        cells.set(colIngredient, ingredientName);
+        cells.set(colUnit, unitName);
+        cells.set(colQuantity, std::to_string(ingredientRecord->quantity));
+        cells.set(colCost, !values.valid ? L"Błąd, nie można obliczyć kosztu" : std::to_wstring(values.price));
+        cells.set(colKcal, std::to_wstring(values.kcal));
+        cells.set(colFats, std::to_wstring(values.fat));
+        cells.set(colSatAcids, std::to_wstring(values.saturatedAcids));
+        cells.set(colCarbs, std::to_wstring(values.carbohydrates));
+        cells.set(colSugar, std::to_wstring(values.sugar));
+        cells.set(colProtein, std::to_wstring(values.protein));
+        cells.set(colSalt, std::to_wstring(values.salt));
+        cells.set(colDelete, "X");
     }
 
     void populateIngredientTable() {
-        rowToID.clear();
+        Tracing::Span span{"RecipeDetailsWidget::populateIngredientTable"};
+        recordIDs.clear();
+        auto firmCatalog = catalog();
+
+        populateTable<IngredientRecord>(*db, *ingredientList, schema, db->find<IngredientRecord>().where("recipe_id = ?").bind(currentRecipe),
+            [&](const Wt::Dbo::ptr<IngredientRecord>& ingredientRecord, TableRow& cells) {
+                recordIDs.push_back(ingredientRecord.id());
+                fillRecordRow(*firmCatalog, ingredientRecord, cells);
+            });
+    }
 
-        populateTable<IngredientRecord>(*db, *ingredientList,
-            [&](const Wt::Dbo::ptr<IngredientRecord>& ingredientRecord, int row) {
+    // only the new row is filled, rest of the table stays as it is
+    void appendRecord(const Wt::Dbo::ptr<IngredientRecord>& ingredientRecord) {
+        auto row = ingredientList->rowCount();
+        auto cells = TableRow{schema};
+        fillRecordRow(*catalog(), ingredientRecord, cells);
+        fillTableRow(*ingredientList, row, cells);
+        recordIDs.push_back(ingredientRecord.id());
+    }
+
+    // rewrites all rows from the catalog and current records, e.g. after an ingredient or a unit was changed elsewhere
+    void refreshRecordRows() {
+        auto firmCatalog = catalog();
+        auto cells = TableRow{schema};
+
+        auto transaction = Wt::Dbo::Transaction{*db};
+        Wt::Dbo::collection<Wt::Dbo::ptr<IngredientRecord>> records = db->find<IngredientRecord>().where("recipe_id = ?").bind(currentRecipe);
+        for (const auto& ingredientRecord : records) {
+            auto row = rowOf(ingredientRecord.id());
+            if (row == -1)
+                continue;
+
+            cells.clear();
+            fillRecordRow(*firmCatalog, ingredientRecord, cells);
+            updateTableRow(*ingredientList, row, cells);
+        }
+    }
+
+    // true(after telling the user) if the record was deleted meanwhile by another session, its row goes away with that change
+    static bool removedMeanwhile(const Wt::Dbo::ptr<IngredientRecord>& ingredientRecord) {
+        if (ingredientRecord.id() != Wt::Dbo::dbo_traits<IngredientRecord>::invalidId())
+            return false;
+
+        showMessageDialog(L"Składnik przepisu nie istnieje", L"Składnik został w międzyczasie usunięty z przepisu.");
+        return true;
+    }
+
+    // other widgets get the change of the record and of totals of the recipe
+    void publishRecordChange(FirmChanges::Kind kind, Wt::Dbo::dbo_traits<IngredientRecord>::IdType id) {
+        auto firmID = db->currentUser().firmID;
+        FirmChanges::instance().publish(firmID, {FirmChanges::Entity::IngredientRecord, kind, id, currentRecipe}, changes);
+        FirmChanges::instance().publish(firmID, {FirmChanges::Entity::Recipe, FirmChanges::Kind::Changed, currentRecipe}, changes);
+    }
+
+    // change made by another widget(or session), the table is patched so that cells being edited stay as they are
+    void applyChange(const FirmChanges::Change& change) {
+        if (currentRecipe == Wt::Dbo::dbo_traits<Recipe>::invalidId())
+            return;
+
+        if (change.entity == FirmChanges::Entity::IngredientRecord && change.recipeID == currentRecipe) {
+            auto row = rowOf(change.id);
+            if (change.kind == FirmChanges::Kind::Added && row == -1) {
                 auto transaction = Wt::Dbo::Transaction{*db};
-                rowToID.insert(std::make_pair(row, ingredientRecord.id()));
-                std::vector<std::pair<std::wstring, Wt::WString>> columns;
-
-                Wt::Dbo::ptr<Unit> unit = db->find<Unit>().where("id = ?").bind(ingredientRecord->unitID);
-                auto unitName = unit.id() != Wt::Dbo::dbo_traits<Unit>::invalidId() ? unit->name : L"Błędna jednostka";
-
-                Wt::Dbo::ptr<Ingredient> ingredient = db->find<Ingredient>().where("id = ?").bind(ingredientRecord->ingredientID);
-                auto ingredientName =
-                    ingredient.id() != Wt::Dbo::dbo_traits<Ingredient>::invalidId() ? ingredient->name : L"Błędny skladnik";
-
-                auto cost = ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.price; });
-                auto kcal = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.kcal; }));
-                auto fat = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.fat; }));
-                auto saturatedAcids = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.saturatedAcids; }));
-                auto carbohydrates = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.carbohydrates; }));
-                auto sugar = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.sugar; }));
-                auto protein = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.protein; }));
-                auto salt = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.salt; }));
-
-                columns.emplace_back(colIngredient, ingredientName);
-                columns.emplace_back(colUnit, unitName);
-                columns.emplace_back(colQuantity, std::to_string(ingredientRecord->quantity));
-                if(db->users->find(db->login.user())->user()->accessLevel != 0)
-                    columns.emplace_back(colCost, cost == -1 ? L"Błąd, nie można obliczyć kosztu" : std::to_wstring(cost));
-
-                columns.emplace_back(colKcal, kcal);
-                columns.emplace_back(colFats, fat);
-                columns.emplace_back(colSatAcids, saturatedAcids);
-                columns.emplace_back(colCarbs, carbohydrates);
-                columns.emplace_back(colSugar, sugar);
-                columns.emplace_back(colProtein, protein);
-                columns.emplace_back(colSalt, salt);
-
-                if(db->users->find(db->login.user())->user()->accessLevel != 0)
-                    columns.emplace_back(colDelete, "X");
-                return columns;
-            },
-            [&](const Wt::Dbo::ptr<IngredientRecord>& element) {
-                Wt::Dbo::Transaction t{*db};
-                return element->recipe.id() == currentRecipe; 
-            });
+                Wt::Dbo::ptr<IngredientRecord> added = db->find<IngredientRecord>().where("id = ?").bind(change.id);
+                if (added.id() != Wt::Dbo::dbo_traits<IngredientRecord>::invalidId())
+                    appendRecord(added);
+            } else if (change.kind == FirmChanges::Kind::Removed && row != -1) {
+                ingredientList->deleteRow(row);
+                recordIDs.erase(recordIDs.begin() + (row - ingredientList->headerCount()));
+            } else if (change.kind == FirmChanges::Kind::Changed) {
+                reread<IngredientRecord>(*db, change.id);
+                refreshRecordRows();
+            }
+        } else if (change.entity == FirmChanges::Entity::Recipe && change.kind == FirmChanges::Kind::Removed && change.id == currentRecipe) {
+            populateIngredientTable();
+        } else if (change.entity == FirmChanges::Entity::Ingredient || change.entity == FirmChanges::Entity::Unit) {
+            refreshRecordRows();
+        }
     }
 
     void makeTableEditable() {
          // make ingredient field editable
         auto ingredientKeys = std::make_shared<std::vector<Wt::Dbo::dbo_traits<Ingredient>::IdType>>();
         makeCellsInteractive<Wt::WComboBox>(
-            *ingredientList, colIngredient,
+            *ingredientClicks, schema.column(colIngredient),
             [this, ingredientKeys](int row, Wt::WComboBox& editField) {
-                *ingredientKeys = populateComboBox<Ingredient>(*db, editField, [](const Ingredient& ingredient) { return ingredient.name; },
-                    [this](const Wt::Dbo::ptr<Ingredient>& elem) { return elem->ownerID == db->users->find(db->login.user())->user()->firmID; });
+                *ingredientKeys = populateComboBox(editField, catalog()->ingredients);
 
-                auto oldContent = (Wt::WText*)ingredientList->elementAt(row, findColumn(*ingredientList, colIngredient))->widget(0);
+                auto oldContent = (Wt::WText*)ingredientList->elementAt(row, schema.column(colIngredient))->widget(0);
                 auto oldIngredientName = oldContent->text();
                 auto indexOfOldIngredient = editField.findText(oldIngredientName);
                 editField.setCurrentIndex(indexOfOldIngredient);
             },
-            [this, ingredientKeys](int row, const Wt::WComboBox& filledEditField, Wt::WString) {
+            [this, ingredientKeys](int row, const Wt::WComboBox& filledEditField, Wt::WString oldContent) {
                 auto transaction = Wt::Dbo::Transaction(*db);
 
-                auto ingredientRecord = (Wt::Dbo::ptr<IngredientRecord>)db->find<IngredientRecord>().where("id = ?").bind(rowToID[row]);
-                auto ingredient = (Wt::Dbo::ptr<Ingredient>)db->find<Ingredient>().where("id = ?").bind((*ingredientKeys)[filledEditField.currentIndex()]);
-                if (ingredient.id() != ingredientRecord->ingredientID) {
-                    ingredientRecord.modify()->ingredientID = ingredient.id();
-
-                    auto cost = ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.price; });
-                    auto kcal = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.kcal; }));
-                    auto fat = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.fat; }));
-                    auto saturatedAcids = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.saturatedAcids; }));
-                    auto carbohydrates = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.carbohydrates; }));
-                    auto sugar = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.sugar; }));
-                    auto protein = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.protein; }));
-                    auto salt = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.salt; }));
-
-                    updateColumn(colCost, row, cost == -1 ? L"Błąd, nie można obliczyć kosztu" : std::to_wstring(cost));
-                    updateColumn(colKcal, row, kcal);
-                    updateColumn(colFats, row, fat);
-                    updateColumn(colSatAcids, row, saturatedAcids);
-                    updateColumn(colCarbs, row, carbohydrates);
-                    updateColumn(colSugar, row, sugar);
-                    updateColumn(colProtein, row, protein);
-                    updateColumn(colSalt, row, salt);
+                auto ingredientRecord = (Wt::Dbo::ptr<IngredientRecord>)db->find<IngredientRecord>().where("id = ?").bind(recordAt(row));
+                if (removedMeanwhile(ingredientRecord))
+                    return oldContent;
+
+                auto ingredientID = (*ingredientKeys)[filledEditField.currentIndex()];
+                if (ingredientID != ingredientRecord->ingredientID) {
+                    ingredientRecord.modify()->ingredientID = ingredientID;
+
+                    RecipeTotals::recipeChanged(*db, db->currentUser().firmID, currentRecipe);
+                    transaction.commit();
+                    updateValueColumns(row, ingredientRecord->scaled(*catalog()));
+                    publishRecordChange(FirmChanges::Kind::Changed, ingredientRecord.id());
                 }
 
                 return filledEditField.currentText();
             });
 
         // make ingredient quantity editable
-        makeTextCellsInteractive(*ingredientList, colQuantity, [&](int row, const Wt::WLineEdit& filledField, Wt::WString oldContent) {
+        makeTextCellsInteractive(*ingredientClicks, schema.column(colQuantity), [&](int row, const Wt::WLineEdit& filledField, Wt::WString oldContent) {
             Wt::WDoubleValidator validator;
             validator.setMandatory(true);
             if (validator.validate(filledField.text()).state() != Wt::WValidator::Valid) {
                 return oldContent.narrow();
             }
             Wt::Dbo::Transaction transaction(*db);
-            Wt::Dbo::ptr<IngredientRecord> ingredientRecord = db->find<IngredientRecord>().where("id = ?").bind(rowToID[row]);
+            Wt::Dbo::ptr<IngredientRecord> ingredientRecord = db->find<IngredientRecord>().where("id = ?").bind(recordAt(row));
+            if (removedMeanwhile(ingredientRecord))
+                return oldContent.narrow();
+
             if (std::stod(filledField.text()) != ingredientRecord->quantity) {
                 ingredientRecord.modify()->quantity = std::stod(filledField.text());
 
-                auto cost = ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.price; });
-                auto kcal = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.kcal; }));
-                auto fat = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.fat; }));
-                auto saturatedAcids = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.saturatedAcids; }));
-                auto carbohydrates = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.carbohydrates; }));
-                auto sugar = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.sugar; }));
-                auto protein = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.protein; }));
-                auto salt = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.salt; }));
-
-                updateColumn(colCost, row, cost == -1 ? L"Błąd, nie można obliczyć kosztu" : std::to_wstring(cost));
-                updateColumn(colKcal, row, kcal);
-                updateColumn(colFats, row, fat);
-                updateColumn(colSatAcids, row, saturatedAcids);
-                updateColumn(colCarbs, row, carbohydrates);
-                updateColumn(colSugar, row, sugar);
-                updateColumn(colProtein, row, protein);
-                updateColumn(colSalt, row, salt);
+                RecipeTotals::recipeChanged(*db, db->currentUser().firmID, currentRecipe);
+                transaction.commit();
+                updateValueColumns(row, ingredientRecord->scaled(*catalog()));
+                publishRecordChange(FirmChanges::Kind::Changed, ingredientRecord.id());
             }
 
             return std::to_string(ingredientRecord->quantity);
@@ -267,47 +348,39 @@ class RecipeDetailsWidget : public Wt::WContainerWidget {
         // make ingredient unit editable
         auto unitKeys = std::make_shared<std::vector<Wt::Dbo::dbo_traits<Unit>::IdType>>();
         makeCellsInteractive<Wt::WComboBox>(
-            *ingredientList, colUnit,
+            *ingredientClicks, schema.column(colUnit),
             [this, unitKeys](int row, Wt::WComboBox& editField) {
-                *unitKeys = populateComboBox<Unit>(
-                    *db, editField, [](const Unit& unit) { return unit.name; },
-                    [this, row](Wt::Dbo::ptr<Unit> potentialUnit) {
-                        auto transaction = Wt::Dbo::Transaction(*db);
-                        auto ingredientRecord = (Wt::Dbo::ptr<IngredientRecord>)db->find<IngredientRecord>().where("id = ?").bind(rowToID[row]);
-                        return Unit::sameBranch(*db, potentialUnit.id(), ingredientRecord->unitID);
-                    });
-
-                auto oldContent = (Wt::WText*)ingredientList->elementAt(row, findColumn(*ingredientList, colUnit))->widget(0);
+                auto transaction = Wt::Dbo::Transaction(*db);
+                auto ingredientRecord = (Wt::Dbo::ptr<IngredientRecord>)db->find<IngredientRecord>().where("id = ?").bind(recordAt(row));
+                if (ingredientRecord.id() == Wt::Dbo::dbo_traits<IngredientRecord>::invalidId())
+                    return;  // left empty, confirming the editor tells the user
+
+                auto firmCatalog = catalog();
+                *unitKeys = populateComboBox(editField, firmCatalog->units, [&](Wt::Dbo::dbo_traits<Unit>::IdType unitID, const Unit&) {
+                    return Unit::sameBranch(firmCatalog->conversions, unitID, ingredientRecord->unitID);
+                });
+
+                auto oldContent = (Wt::WText*)ingredientList->elementAt(row, schema.column(colUnit))->widget(0);
                 auto oldUnitName = oldContent->text();
                 auto indexOfOldUnit = editField.findText(oldUnitName);
                 editField.setCurrentIndex(indexOfOldUnit);
             },
-            [this, unitKeys](int row, const Wt::WComboBox& filledEditField, Wt::WString) {
+            [this, unitKeys](int row, const Wt::WComboBox& filledEditField, Wt::WString oldContent) {
                 auto transaction = Wt::Dbo::Transaction(*db);
 
-                auto ingredientRecord = (Wt::Dbo::ptr<IngredientRecord>)db->find<IngredientRecord>().where("id = ?").bind(rowToID[row]);
-                auto unit = (Wt::Dbo::ptr<Unit>)db->find<Unit>().where("id = ?").bind((*unitKeys)[filledEditField.currentIndex()]);
-
-                if (ingredientRecord->unitID != unit.id()) {
-                    ingredientRecord.modify()->unitID = unit.id();
-
-                    auto cost = ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.price; });
-                    auto kcal = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.kcal; }));
-                    auto fat = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.fat; }));
-                    auto saturatedAcids = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.saturatedAcids; }));
-                    auto carbohydrates = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.carbohydrates; }));
-                    auto sugar = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.sugar; }));
-                    auto protein = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.protein; }));
-                    auto salt = std::to_wstring(ingredientRecord->scaledIngredientValue(*db, [](const Ingredient& i) { return i.salt; }));
-
-                    updateColumn(colCost, row, cost == -1 ? L"Błąd, nie można obliczyć kosztu" : std::to_wstring(cost));
-                    updateColumn(colKcal, row, kcal);
-                    updateColumn(colFats, row, fat);
-                    updateColumn(colSatAcids, row, saturatedAcids);
-                    updateColumn(colCarbs, row, carbohydrates);
-                    updateColumn(colSugar, row, sugar);
-                    updateColumn(colProtein, row, protein);
-                    updateColumn(colSalt, row, salt);
+                auto ingredientRecord = (Wt::Dbo::ptr<IngredientRecord>)db->find<IngredientRecord>().where("id = ?").bind(recordAt(row));
+                if (removedMeanwhile(ingredientRecord))
+                    return oldContent;
+
+                auto unitID = (*unitKeys)[filledEditField.currentIndex()];
+
+                if (ingredientRecord->unitID != unitID) {
+                    ingredientRecord.modify()->unitID = unitID;
+
+                    RecipeTotals::recipeChanged(*db, db->currentUser().firmID, currentRecipe);
+                    transaction.commit();
+                    updateValueColumns(row, ingredientRecord->scaled(*catalog()));
+                    publishRecordChange(FirmChanges::Kind::Changed, ingredientRecord.id());
                 }
 
                 return filledEditField.currentText();
@@ -315,34 +388,43 @@ class RecipeDetailsWidget : public Wt::WContainerWidget {
     }
 
     void setupDeleteAction() {
-        auto column = findColumn(*ingredientList, colDelete);
-        if (column == -1)
-            return;
+        ingredientClicks->onColumn(schema.column(colDelete), [this](Wt::WTableCell* cell) {
+            auto recordID = recordAt(cell->row());
+
+            auto confirmationDialog = new Wt::WDialog(L"Potwierdzenie usunięcia składnika przepisu");
+            auto yesButton = new Wt::WPushButton("Tak", confirmationDialog->footer());
+            auto noButton = new Wt::WPushButton("Nie", confirmationDialog->footer());
+            new Wt::WText(L"Czy napewno usunąć składnik tego przepisu?", confirmationDialog->contents());
+            yesButton->clicked().connect(confirmationDialog, &Wt::WDialog::accept);
+            noButton->clicked().connect(confirmationDialog, &Wt::WDialog::reject);
+            confirmationDialog->rejectWhenEscapePressed();
+
+            confirmationDialog->finished().connect(std::bind([this, confirmationDialog, recordID] {
+                if (confirmationDialog->result() == Wt::WDialog::Accepted) {
+                    Wt::Dbo::Transaction transaction(*db);
 
-        for (auto row = ingredientList->headerCount(); row < ingredientList->rowCount(); row++) {
-            ingredientList->elementAt(row, column)->clicked().connect(std::bind([this, row] {
-                auto confirmationDialog = new Wt::WDialog(L"Potwierdzenie usunięcia składnika przepisu");
-                auto yesButton = new Wt::WPushButton("Tak", confirmationDialog->footer());
-                auto noButton = new Wt::WPushButton("Nie", confirmationDialog->footer());
-                new Wt::WText(L"Czy napewno usunąć składnik tego przepisu?", confirmationDialog->contents());
-                yesButton->clicked().connect(confirmationDialog, &Wt::WDialog::accept);
-                noButton->clicked().connect(confirmationDialog, &Wt::WDialog::reject);
-                confirmationDialog->rejectWhenEscapePressed();
-
-                confirmationDialog->finished().connect(std::bind([this, confirmationDialog, row] {
-                    if (confirmationDialog->result() != Wt::WDialog::Accepted)
+                    auto ingredientRecord = (Wt::Dbo::ptr<IngredientRecord>)db->find<IngredientRecord>().where("id = ?").bind(recordID);
+                    if (removedMeanwhile(ingredientRecord)) {
+                        delete confirmationDialog;
                         return;
+                    }
 
-                    Wt::Dbo::Transaction transaction(*db);
-
-                    auto ingredientRecord = (Wt::Dbo::ptr<IngredientRecord>)db->find<IngredientRecord>().where("id = ?").bind(rowToID[row]);
                     ingredientRecord.remove();
-                    populateIngredientList();  // deleting screws up references to rows in lambdas inside, so rebuild table
-                    delete confirmationDialog;
-                }));
+                    RecipeTotals::recipeChanged(*db, db->currentUser().firmID, currentRecipe);
+                    transaction.commit();
+                    publishRecordChange(FirmChanges::Kind::Removed, recordID);
+
+                    auto row = rowOf(recordID);
+                    if (row != -1) {
+                        ingredientList->deleteRow(row);
+                        recordIDs.erase(recordIDs.begin() + (row - ingredientList->headerCount()));
+                    }
+                }
 
-                confirmationDialog->show();
+                delete confirmationDialog;
             }));
-        }
+
+            confirmationDialog->show();
+        });
     }
 };
@@ -0,0 +1,350 @@
+#pragma once
+#include <cmath>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <utility>
+#include <sstream>
+#include <iomanip>
+#include <initializer_list>
+#include <boost/any.hpp>
+#include <boost/optional.hpp>
+#include <Wt/WResource>
+#include <Wt/WLogger>
+#include <Wt/Http/Request>
+#include <Wt/Http/Response>
+#include <Wt/Http/ResponseContinuation>
+#include <Wt/Dbo/Dbo>
+#include "database.h"
+#include "ConnectionPool.h"
+#include "Schema.h"
+#include "FirmCatalog.h"
+#include "RecipeSummary.h"
+#include "Recipe.h"
+#include "GzipStream.h"
+
+// Recipes of a firm with their ingredient lines and totals, as CSV or JSON(?format=json), e.g. for nightly reports of the management.
+// The response is sent in chunks of recipesPerChunk recipes through continuations, so memory doesn't grow with the number of recipes.
+// Totals are the ones of RecipesWidget(recipe_totals), lines are scaled like in RecipeDetailsWidget, and everything is compressed
+// with gzip on the fly if the client accepts it. Recipes changed during the export may come out as they were before or after the change.
+// Values which can't be computed(e.g. a unit with quantity 0) are left empty in CSV and null in JSON.
+// Status 200 is sent with the first chunk, so a failure later on(e.g. lost database connection) ends the body with an error instead:
+// a last CSV row of type "error" with the message in the recipe column, or an "error" member next to "recipes" in JSON.
+// Deployed by main() at /export/recipes for any firm(?firm=) given the export-token, and by RecipesWidget for the firm of the session.
+class RecipeExportResource : public Wt::WResource {
+   public:
+    static constexpr int recipesPerChunk = 200;
+
+    // server-wide, firm is given as ?firm= together with ?token=
+    RecipeExportResource(ConnectionPool& pool, std::string token) : pool(pool), token(std::move(token)) {}
+
+    // of a session, only its firm; prices are left out for users who don't see them in the application
+    RecipeExportResource(ConnectionPool& pool, int firmID, bool prices) : pool(pool), firmID(firmID), prices(prices) {}
+
+    ~RecipeExportResource() override {
+        beingDeleted();
+    }
+
+    void handleRequest(const Wt::Http::Request& request, Wt::Http::Response& response) override {
+        auto continuation = request.continuation();
+        auto state = continuation ? boost::any_cast<std::shared_ptr<Export>>(continuation->data()) : start(request, response);
+        if (!state)
+            return;  // refused
+
+        try {
+            writeChunk(*state, response);
+        } catch (const std::exception& e) {
+            // headers are gone already, the client learns about it from the end of the body
+            Wt::log("error") << "RecipeExportResource: firm " << state->firmID << ": " << e.what();
+            writeError(*state, e.what(), response);
+            return;
+        }
+
+        if (!state->finished)
+            response.createContinuation()->setData(state);
+    }
+
+   private:
+    using RecipeID = RecipeSummary::RecipeID;
+    using LineRow = std::tuple<RecipeID, FirmCatalog::IngredientID, double, FirmCatalog::UnitID>;
+
+    // everything kept between the chunks of one download
+    struct Export {
+        explicit Export(ConnectionPool& pool) : db(pool) {
+            Schema::mapClasses(db);
+        }
+
+        Database db;  // own session, only plain rows are read, so nothing accumulates in it
+        int firmID = -1;
+        bool json = false;
+        bool prices = true;
+        FirmCatalog::SnapshotPtr catalog;  // the same one for all chunks, so that lines of all recipes are scaled alike
+        RecipeID last = Wt::Dbo::dbo_traits<Recipe>::invalidId();
+        int recipes = 0;
+        bool finished = false;
+        std::unique_ptr<GzipStream> gzip;
+    };
+
+    // checks access and sends headers, nullptr if the request is refused
+    std::shared_ptr<Export> start(const Wt::Http::Request& request, Wt::Http::Response& response) {
+        auto firm = firmID;
+        if (firm == -1) {
+            auto given = request.getParameter("token");
+            auto firmParameter = request.getParameter("firm");
+            if (token.empty() || !given || *given != token) {
+                response.setStatus(403);
+                return nullptr;
+            }
+
+            try {
+                auto parsed = std::size_t{0};
+                if (firmParameter)
+                    firm = std::stoi(*firmParameter, &parsed);
+                if (!firmParameter || parsed != firmParameter->size())
+                    firm = -1;
+            } catch (const std::exception&) {
+                firm = -1;
+            }
+
+            if (firm <= 0) {
+                response.setStatus(400);
+                return nullptr;
+            }
+        }
+
+        auto format = request.getParameter("format");
+        auto state = std::make_shared<Export>(pool);
+        state->firmID = firm;
+        state->json = format && *format == "json";
+        state->prices = prices;
+        state->catalog = FirmCatalog::instance().snapshot(state->db, firm);
+
+        response.setMimeType(state->json ? "application/json" : "text/csv; charset=utf-8");
+        response.addHeader("Content-Disposition", std::string{"attachment; filename=recipes."} + (state->json ? "json" : "csv"));
+        response.addHeader("Vary", "Accept-Encoding");
+        if (request.headerValue("Accept-Encoding").find("gzip") != std::string::npos) {
+            response.addHeader("Content-Encoding", "gzip");
+            state->gzip = std::make_unique<GzipStream>();
+        }
+
+        return state;
+    }
+
+    void writeChunk(Export& state, Wt::Http::Response& response) {
+        auto out = std::ostringstream{};
+        out << std::fixed << std::setprecision(4);
+        if (state.last == Wt::Dbo::dbo_traits<Recipe>::invalidId())
+            writeHeader(state, out);  // first chunk(or the only one, if the firm has no recipes)
+
+        auto recipes = RecipeSummary::loadAfter(state.db, state.firmID, state.last, recipesPerChunk);
+        auto lines = loadLines(state, recipes);
+        auto line = lines.begin();
+        for (const auto& recipe : recipes) {
+            auto end = line;
+            while (end != lines.end() && std::get<0>(*end) == recipe.id) {
+                ++end;
+            }
+
+            if (state.json)
+                writeJson(state, recipe, line, end, out);
+            else
+                writeCsv(state, recipe, line, end, out);
+
+            line = end;
+            state.recipes++;
+        }
+
+        if (!recipes.empty())
+            state.last = recipes.back().id;
+
+        if (recipes.size() < static_cast<std::size_t>(recipesPerChunk)) {
+            state.finished = true;
+            if (state.json)
+                out << "\n]}\n";
+        }
+
+        if (state.gzip)
+            state.gzip->write(out.str(), state.finished, response.out());
+        else
+            response.out() << out.str();
+    }
+
+    // nothing more is sent afterwards; the header comes first if the failure was in the first chunk
+    void writeError(Export& state, const std::string& message, Wt::Http::Response& response) {
+        auto out = std::ostringstream{};
+        if (state.last == Wt::Dbo::dbo_traits<Recipe>::invalidId() && state.recipes == 0)
+            writeHeader(state, out);
+
+        if (state.json)
+            out << "\n],\"error\":" << json(message) << "}\n";
+        else
+            out << "error,," << csv(message) << "\n";
+
+        state.finished = true;
+        if (state.gzip)
+            state.gzip->write(out.str(), true, response.out());
+        else
+            response.out() << out.str();
+    }
+
+    // lines of the given recipes(one page, in the order of ids) as plain values, ordered by recipe
+    std::vector<LineRow> loadLines(Export& state, const std::vector<RecipeSummary>& recipes) {
+        if (recipes.empty())
+            return {};
+
+        auto transaction = Wt::Dbo::Transaction{state.db};
+        Wt::Dbo::collection<LineRow> rows = state.db.query<LineRow>("select ir.recipe_id, ir.ingredient_id, ir.quantity, ir.unit_id from ingredient_record ir"
+                                                                    " join recipe r on r.id = ir.recipe_id")
+                                                .where("r.owner_id = ? and ir.recipe_id >= ? and ir.recipe_id <= ?")
+                                                .bind(state.firmID).bind(recipes.front().id).bind(recipes.back().id)
+                                                .orderBy("ir.recipe_id, ir.id");
+        return std::vector<LineRow>(rows.begin(), rows.end());
+    }
+
+    void writeHeader(const Export& state, std::ostream& out) {
+        if (state.json) {
+            out << "{\"recipes\":[";
+            return;
+        }
+
+        out << "type,recipe_id,recipe,ingredient,quantity,unit," << (state.prices ? "price," : "")
+            << "kcal,fat,saturated_acids,carbohydrates,sugar,protein,salt\n";
+    }
+
+    // a row of the recipe with its totals, followed by rows of its lines; values which can't be computed are empty
+    void writeCsv(const Export& state, const RecipeSummary& recipe, std::vector<LineRow>::const_iterator line, std::vector<LineRow>::const_iterator end,
+                  std::ostream& out) {
+        out << "recipe," << recipe.id << "," << csv(recipe.name.toUTF8()) << ",,,";
+        writeCsvValues(state, recipe.totals, out);
+
+        for (; line != end; ++line) {
+            auto record = lineRecord(*line);
+            auto ingredient = state.catalog->ingredient(record.ingredientID);
+            auto unit = state.catalog->unit(record.unitID);
+            out << "ingredient," << recipe.id << "," << csv(recipe.name.toUTF8()) << "," << (ingredient ? csv(ingredient->name.toUTF8()) : "") << ",";
+            writeNumber(record.quantity, "", out);
+            out << "," << (unit ? csv(unit->name.toUTF8()) : "") << ",";
+            writeCsvValues(state, record.scaled(*state.catalog), out);
+        }
+    }
+
+    void writeCsvValues(const Export& state, const NutritionVector& values, std::ostream& out) {
+        if (!values.valid) {
+            out << (state.prices ? ",,,,,,,\n" : ",,,,,,\n");
+            return;
+        }
+
+        auto separator = "";
+        for (const auto& value : namedValues(state, values)) {
+            out << separator;
+            writeNumber(value.second, "", out);
+            separator = ",";
+        }
+
+        out << "\n";
+    }
+
+    void writeJson(const Export& state, const RecipeSummary& recipe, std::vector<LineRow>::const_iterator line, std::vector<LineRow>::const_iterator end,
+                   std::ostream& out) {
+        out << (state.recipes > 0 ? ",\n" : "\n") << "{\"id\":" << recipe.id << ",\"name\":" << json(recipe.name.toUTF8()) << ",\"totals\":";
+        writeJsonValues(state, recipe.totals, out);
+        out << ",\"ingredients\":[";
+
+        for (auto first = line; line != end; ++line) {
+            auto record = lineRecord(*line);
+            auto ingredient = state.catalog->ingredient(record.ingredientID);
+            auto unit = state.catalog->unit(record.unitID);
+            out << (line != first ? "," : "") << "{\"ingredient_id\":" << record.ingredientID
+                << ",\"ingredient\":" << (ingredient ? json(ingredient->name.toUTF8()) : "null") << ",\"quantity\":";
+            writeNumber(record.quantity, "null", out);
+            out << ",\"unit\":" << (unit ? json(unit->name.toUTF8()) : "null") << ",\"values\":";
+            writeJsonValues(state, record.scaled(*state.catalog), out);
+            out << "}";
+        }
+
+        out << "]}";
+    }
+
+    // null if the values can't be computed(e.g. an ingredient doesn't exist anymore)
+    void writeJsonValues(const Export& state, const NutritionVector& values, std::ostream& out) {
+        if (!values.valid) {
+            out << "null";
+            return;
+        }
+
+        auto separator = "{";
+        for (const auto& value : namedValues(state, values)) {
+            out << separator << "\"" << value.first << "\":";
+            writeNumber(value.second, "null", out);
+            separator = ",";
+        }
+
+        out << "}";
+    }
+
+    // in the order of the CSV columns, price only if it's shown
+    static std::vector<std::pair<const char*, double>> namedValues(const Export& state, const NutritionVector& values) {
+        auto result = std::vector<std::pair<const char*, double>>{};
+        if (state.prices)
+            result.emplace_back("price", values.price);
+
+        auto nutrition = {std::make_pair("kcal", values.kcal), std::make_pair("fat", values.fat), std::make_pair("saturated_acids", values.saturatedAcids),
+                          std::make_pair("carbohydrates", values.carbohydrates), std::make_pair("sugar", values.sugar),
+                          std::make_pair("protein", values.protein), std::make_pair("salt", values.salt)};
+        result.insert(result.end(), nutrition.begin(), nutrition.end());
+        return result;
+    }
+
+    // infinite or NaN(e.g. scaled by a unit with quantity 0) can't be written in JSON, so they are written as missing in both formats
+    static void writeNumber(double value, const char* missing, std::ostream& out) {
+        if (std::isfinite(value))
+            out << value;
+        else
+            out << missing;
+    }
+
+    // only what IngredientRecord::scaled needs, so that lines aren't loaded as Dbo objects
+    static IngredientRecord lineRecord(const LineRow& line) {
+        auto record = IngredientRecord{};
+        record.ingredientID = std::get<1>(line);
+        record.quantity = std::get<2>(line);
+        record.unitID = std::get<3>(line);
+        return record;
+    }
+
+    static std::string csv(const std::string& value) {
+        if (value.find_first_of(",\"\r\n") == std::string::npos)
+            return value;
+
+        auto quoted = std::string{"\""};
+        for (auto c : value) {
+            quoted += c == '"' ? std::string{"\"\""} : std::string(1, c);
+        }
+
+        return quoted + "\"";
+    }
+
+    static std::string json(const std::string& value) {
+        auto escaped = std::string{"\""};
+        for (auto c : value) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+                escaped += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                auto code = std::ostringstream{};
+                code << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c);
+                escaped += code.str();
+            } else {
+                escaped += c;
+            }
+        }
+
+        return escaped + "\"";
+    }
+
+    ConnectionPool& pool;
+    const std::string token;
+    const int firmID = -1;  // -1 for the server-wide resource
+    const bool prices = true;
+};
@@ -0,0 +1,188 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <boost/tuple/tuple.hpp>
+#include <Wt/WString>
+#include <Wt/Dbo/Dbo>
+#include <Wt/Dbo/WtSqlTraits>
+#include "database.h"
+#include "Recipe.h"
+
+// Server-wide index of recipe names for the filter box, one per firm: trigrams of folded names(lowercase, without Polish diacritics) -> recipes.
+// Firm's index is built with a single query on its first search and later kept up to date by sessions adding, renaming and deleting recipes,
+// so it assumes all sessions live in one server process.
+class RecipeSearchIndex {
+   public:
+    using RecipeID = Wt::Dbo::dbo_traits<Recipe>::IdType;
+
+    static RecipeSearchIndex& instance() {
+        static RecipeSearchIndex index;
+        return index;
+    }
+
+    // ids(ascending) of firm's recipes whose name contains the text, ignoring case and diacritics
+    std::vector<RecipeID> search(Database& db, int firmID, const Wt::WString& text) {
+        auto pattern = fold(text);
+        auto version = std::uint64_t{0};
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            auto& firm = firms[firmID];
+            if (firm.loaded)
+                return matches(firm.index, pattern);
+
+            version = firm.version;
+        }
+
+        // query runs without the lock, other firms can be searched meanwhile
+        auto loaded = load(db, firmID);
+
+        std::lock_guard<std::mutex> lock{mutex};
+        auto& firm = firms[firmID];
+        if (!firm.loaded && firm.version != version)
+            return matches(loaded, pattern);  // a change committed while loading may or may not be in it, so it's used only by this call
+
+        if (!firm.loaded) {
+            firm.index = std::move(loaded);
+            firm.loaded = true;
+        }  // otherwise another session was faster, its index is kept
+
+        return matches(firm.index, pattern);
+    }
+
+    // adds a new recipe or updates name of an existing one
+    void put(int firmID, RecipeID id, const Wt::WString& name) {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto& firm = firms[firmID];
+        firm.version++;
+        if (!firm.loaded)
+            return;  // not loaded yet, it will be read from the database
+
+        erase(firm.index, id);
+        insert(firm.index, id, fold(name));
+    }
+
+    void remove(int firmID, RecipeID id) {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto& firm = firms[firmID];
+        firm.version++;
+        if (firm.loaded)
+            erase(firm.index, id);
+    }
+
+    // lowercase, with Polish letters replaced by their base latin letters
+    static std::wstring fold(const Wt::WString& text) {
+        static const std::wstring from = L"ąćęłńóśźżĄĆĘŁŃÓŚŹŻ";
+        static const std::wstring to = L"acelnoszzacelnoszz";
+
+        auto result = text.value();
+        for (auto& c : result) {
+            auto polish = from.find(c);
+            if (polish != std::wstring::npos)
+                c = to[polish];
+            else if (c >= L'A' && c <= L'Z')
+                c = c - L'A' + L'a';
+        }
+
+        return result;
+    }
+
+   private:
+    using Trigram = std::uint64_t;
+
+    struct FirmIndex {
+        std::unordered_map<RecipeID, std::wstring> names;  // folded
+        std::unordered_map<Trigram, std::unordered_set<RecipeID>> postings;
+    };
+
+    // same guard as in FirmCatalog: put/remove raise the version even before the firm is loaded, so that an index read meanwhile isn't kept
+    struct Firm {
+        FirmIndex index;
+        bool loaded = false;
+        std::uint64_t version = 0;
+    };
+
+    RecipeSearchIndex() = default;
+
+    static std::vector<RecipeID> matches(const FirmIndex& firm, const std::wstring& pattern) {
+        auto results = std::vector<RecipeID>{};
+
+        if (pattern.size() < 3) {
+            // too short to have a trigram, but names of a single firm are few enough to scan
+            for (const auto& recipe : firm.names) {
+                if (recipe.second.find(pattern) != std::wstring::npos)
+                    results.push_back(recipe.first);
+            }
+        } else {
+            // candidates have every trigram of the pattern, start from the rarest one
+            auto rarest = static_cast<const std::unordered_set<RecipeID>*>(nullptr);
+            for (auto i = 0u; i + 3 <= pattern.size(); i++) {
+                auto postings = firm.postings.find(trigram(pattern, i));
+                if (postings == firm.postings.end())
+                    return results;
+
+                if (!rarest || postings->second.size() < rarest->size())
+                    rarest = &postings->second;
+            }
+
+            // trigrams may come from different places of the name, so check the whole pattern
+            for (auto id : *rarest) {
+                if (firm.names.at(id).find(pattern) != std::wstring::npos)
+                    results.push_back(id);
+            }
+        }
+
+        std::sort(results.begin(), results.end());
+        return results;
+    }
+
+    static Trigram trigram(const std::wstring& text, std::size_t position) {
+        // code points fit in 21 bits
+        return (static_cast<Trigram>(text[position]) << 42) | (static_cast<Trigram>(text[position + 1]) << 21) | static_cast<Trigram>(text[position + 2]);
+    }
+
+    static void insert(FirmIndex& firm, RecipeID id, std::wstring foldedName) {
+        for (auto i = 0u; i + 3 <= foldedName.size(); i++) {
+            firm.postings[trigram(foldedName, i)].insert(id);
+        }
+
+        firm.names[id] = std::move(foldedName);
+    }
+
+    static void erase(FirmIndex& firm, RecipeID id) {
+        auto name = firm.names.find(id);
+        if (name == firm.names.end())
+            return;
+
+        for (auto i = 0u; i + 3 <= name->second.size(); i++) {
+            auto postings = firm.postings.find(trigram(name->second, i));
+            if (postings == firm.postings.end())
+                continue;
+
+            postings->second.erase(id);
+            if (postings->second.empty())
+                firm.postings.erase(postings);
+        }
+
+        firm.names.erase(name);
+    }
+
+    static FirmIndex load(Database& db, int firmID) {
+        using NameTuple = boost::tuple<RecipeID, Wt::WString>;
+        auto loaded = FirmIndex{};
+        Wt::Dbo::Transaction transaction{db};
+        Wt::Dbo::collection<NameTuple> recipes = db.query<NameTuple>("select id, name from recipe").where("owner_id = ?").bind(firmID);
+        for (const auto& recipe : recipes) {
+            insert(loaded, recipe.get<0>(), fold(recipe.get<1>()));
+        }
+
+        return loaded;
+    }
+
+    std::mutex mutex;
+    std::unordered_map<int, Firm> firms;
+};
@@ -0,0 +1,124 @@
+#pragma once
+#include <tuple>
+#include <string>
+#include <vector>
+#include <boost/optional.hpp>
+#include <Wt/Dbo/Dbo>
+#include <Wt/Dbo/WtSqlTraits>
+#include "database.h"
+#include "NutritionVector.h"
+#include "Recipe.h"
+
+// Recipe together with its totals, read from recipe_totals(kept up to date by RecipeTotals).
+struct RecipeSummary {
+    using RecipeID = Wt::Dbo::dbo_traits<Recipe>::IdType;
+
+    RecipeID id = Wt::Dbo::dbo_traits<Recipe>::invalidId();
+    Wt::WString name;
+    NutritionVector totals;
+
+    // only recipes with given ids(e.g. found by RecipeSearchIndex), none means all recipes of the firm.
+    // orderBy may use r.name and total_* columns(e.g. "total_price desc"), limit -1 means all recipes.
+    static std::vector<RecipeSummary> load(Database& db, int firmID, const boost::optional<std::vector<RecipeID>>& ids = boost::none,
+                                           const std::string& orderBy = "r.id", int offset = 0, int limit = -1) {
+        auto transaction = Wt::Dbo::Transaction{db};
+        auto query = firmQuery(db, firmID);
+        if (ids) {
+            query.where("r.id in " + idList(*ids));
+        }
+
+        query.orderBy(orderBy == "r.id" ? orderBy : orderBy + ", r.id");
+        if (limit >= 0) {
+            query.limit(limit).offset(offset);
+        }
+
+        return read(query);
+    }
+
+    // next recipes of the firm in the order of ids, after the given one; each page costs the same however far it is(e.g. exports)
+    static std::vector<RecipeSummary> loadAfter(Database& db, int firmID, RecipeID after, int limit) {
+        auto transaction = Wt::Dbo::Transaction{db};
+        auto query = firmQuery(db, firmID).where("r.id > ?").bind(after);
+        query.orderBy("r.id").limit(limit);
+        return read(query);
+    }
+
+    // none if the recipe doesn't exist(or belongs to another firm)
+    static boost::optional<RecipeSummary> find(Database& db, int firmID, RecipeID id) {
+        auto transaction = Wt::Dbo::Transaction{db};
+        auto query = firmQuery(db, firmID).where("r.id = ?").bind(id);
+
+        auto results = read(query);
+        return results.empty() ? boost::none : boost::make_optional(results.front());
+    }
+
+    static int count(Database& db, int firmID, const boost::optional<std::vector<RecipeID>>& ids = boost::none) {
+        if (ids) {
+            return static_cast<int>(ids->size());
+        }
+
+        auto transaction = Wt::Dbo::Transaction{db};
+        int recipes = db.query<int>("select count(1) from recipe").where("owner_id = ?").bind(firmID);
+        return recipes;
+    }
+
+   private:
+    using Row = std::tuple<RecipeID, Wt::WString, double, double, double, double, double, double, double, double, long long>;
+
+    static Wt::Dbo::Query<Row> firmQuery(Database& db, int firmID) {
+        return db.query<Row>(sql()).where("r.owner_id = ?").bind(firmID);
+    }
+
+    static std::vector<RecipeSummary> read(Wt::Dbo::Query<Row>& query) {
+        Wt::Dbo::collection<Row> rows = query;
+
+        auto results = std::vector<RecipeSummary>{};
+        for (const auto& row : rows) {
+            auto summary = RecipeSummary{};
+            summary.id = std::get<0>(row);
+            summary.name = std::get<1>(row);
+
+            if (std::get<10>(row) != 0) {
+                summary.totals = NutritionVector::invalid();
+            } else {
+                summary.totals.price = std::get<2>(row);
+                summary.totals.kcal = std::get<3>(row);
+                summary.totals.fat = std::get<4>(row);
+                summary.totals.saturatedAcids = std::get<5>(row);
+                summary.totals.carbohydrates = std::get<6>(row);
+                summary.totals.sugar = std::get<7>(row);
+                summary.totals.protein = std::get<8>(row);
+                summary.totals.salt = std::get<9>(row);
+            }
+
+            results.push_back(std::move(summary));
+        }
+
+        return results;
+    }
+
+    // ids are numbers, so they can go into the statement directly instead of thousands of bound parameters
+    static std::string idList(const std::vector<RecipeID>& ids) {
+        if (ids.empty()) {
+            return "(null)";
+        }
+
+        auto list = std::string{"("};
+        for (auto id : ids) {
+            list += (list.size() > 1 ? ", " : "") + std::to_string(id);
+        }
+
+        return list + ")";
+    }
+
+    static std::string total(const std::string& column) {
+        return "coalesce(t.total_" + column + ", 0) as total_" + column;
+    }
+
+    // recipes without a row of totals show zeros, same as recipes without records
+    static std::string sql() {
+        return "select r.id, r.name, " + total("price") + ", " + total("kcal") + ", " + total("fat") + ", " + total("saturated_acids") + ", " +
+               total("carbohydrates") + ", " + total("sugar") + ", " + total("protein") + ", " + total("salt") + ", coalesce(t.invalid_records, 0)"
+               " from recipe r left join recipe_totals t on t.recipe_id = r.id";
+    }
+};
@@ -0,0 +1,124 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <Wt/Dbo/Dbo>
+#include "database.h"
+#include "UnitConversions.h"
+#include "Unit.h"
+#include "Ingredient.h"
+#include "Recipe.h"
+#include "Tracing.h"
+
+// Totals of every recipe, stored in the recipe_totals table so that the recipe list only reads them.
+// Writers call the matching *Changed function inside the transaction of their change, and only recipes depending on the changed
+// record are computed again: ingredient -> recipes with its records, unit -> recipes with records or ingredients in units below it.
+class RecipeTotals {
+   public:
+    using RecipeID = Wt::Dbo::dbo_traits<Recipe>::IdType;
+    using IngredientID = Wt::Dbo::dbo_traits<Ingredient>::IdType;
+    using UnitID = Wt::Dbo::dbo_traits<Unit>::IdType;
+
+    static void createTable(Database& db) {
+        db.execute("create table recipe_totals ("
+                   " recipe_id bigint not null primary key,"
+                   " total_price double precision not null, total_kcal double precision not null, total_fat double precision not null,"
+                   " total_saturated_acids double precision not null, total_carbohydrates double precision not null,"
+                   " total_sugar double precision not null, total_protein double precision not null, total_salt double precision not null,"
+                   " invalid_records integer not null)");
+    }
+
+    // every recipe of every firm, e.g. when the table is created
+    static void rebuild(Database& db) {
+        Wt::Dbo::Transaction transaction{db};
+        Wt::Dbo::collection<int> firms = db.query<int>("select distinct owner_id from recipe");
+        auto firmIDs = std::vector<int>(firms.begin(), firms.end());
+        for (auto firmID : firmIDs) {
+            firmChanged(db, firmID);
+        }
+    }
+
+    // e.g. import of many records at once
+    static void firmChanged(Database& db, int firmID) {
+        recompute(db, firmID, "1 = 1");
+    }
+
+    // records of the recipe were added, changed or removed
+    static void recipeChanged(Database& db, int firmID, RecipeID recipeID) {
+        recompute(db, firmID, "r.id = " + std::to_string(recipeID));
+    }
+
+    static void recipeRemoved(Database& db, RecipeID recipeID) {
+        Wt::Dbo::Transaction transaction{db};
+        db.execute("delete from recipe_totals where recipe_id = ?").bind(recipeID);
+    }
+
+    // values or unit of the ingredient changed
+    static void ingredientChanged(Database& db, int firmID, IngredientID ingredientID) {
+        recompute(db, firmID, "r.id in (select recipe_id from ingredient_record where ingredient_id = " + std::to_string(ingredientID) + ")");
+    }
+
+    // quantity or base unit of the unit changed; conversions are the ones from before the change, moving a unit moves its whole subtree
+    static void unitChanged(Database& db, int firmID, UnitID unitID, const UnitConversions& conversions) {
+        if (!conversions.contains(unitID)) {
+            firmChanged(db, firmID);  // unit was in a cycle, there's no telling which units get a root now
+            return;
+        }
+
+        auto units = idList(conversions.subtree(unitID));
+        recompute(db, firmID, "r.id in (select ir.recipe_id from ingredient_record ir left join ingredient i on i.id = ir.ingredient_id"
+                              " where ir.unit_id in " + units + " or i.unit_id in " + units + ")");
+    }
+
+   private:
+    // recipes is a condition on recipe r of the firm
+    static void recompute(Database& db, int firmID, const std::string& recipes) {
+        Tracing::Span span{"RecipeTotals::recompute"};
+        Wt::Dbo::Transaction transaction{db};
+        db.flush();  // statements below don't see changes which are still only in the session
+
+        db.execute("delete from recipe_totals where recipe_id in (select r.id from recipe r where r.owner_id = ? and " + recipes + ")").bind(firmID);
+        db.execute("insert into recipe_totals (recipe_id, total_price, total_kcal, total_fat, total_saturated_acids, total_carbohydrates,"
+                   " total_sugar, total_protein, total_salt, invalid_records) " +
+                   sql() + " where r.owner_id = ? and " + recipes + " group by r.id")
+            .bind(firmID).bind(firmID).bind(firmID);
+    }
+
+    // ids are numbers, so they can go into the statement directly
+    static std::string idList(const std::vector<UnitID>& ids) {
+        auto list = std::string{"("};
+        for (auto id : ids) {
+            list += (list.size() > 1 ? ", " : "") + std::to_string(id);
+        }
+
+        return list + ")";
+    }
+
+    // factor of every unit of the firm to its root unit(first bound parameter is the firm).
+    // Walk stops at the first unit whose base unit is missing, that unit is the root(same as in UnitConversions). Units in a cycle never reach a root, so they get no row.
+    static std::string unitFactorsSql() {
+        return "(with recursive unit_path(unit_id, next_id, factor, depth) as ("
+               "   select id, base_unit_id, quantity, 0 from unit where owner_id = ?"
+               "   union all"
+               "   select p.unit_id, u.base_unit_id, p.factor * u.quantity, p.depth + 1"
+               "   from unit_path p join unit u on u.id = p.next_id where p.depth < 64"
+               " )"
+               " select unit_id, factor from unit_path p where not exists (select 1 from unit u where u.id = p.next_id))";
+    }
+
+    // quantity of the ingredient record expressed in units the ingredient values are given in; unknown units don't scale
+    static std::string scaledSum(const std::string& column) {
+        return "coalesce(sum(i." + column + " * coalesce(rf.factor, 1) / coalesce(inf.factor, 1) * ir.quantity), 0)";
+    }
+
+    // every record has to point to an existing ingredient, same as in Recipe::totals
+    static std::string sql() {
+        return "select r.id, " + scaledSum("price") + ", " + scaledSum("kcal") + ", " + scaledSum("fat") + ", " + scaledSum("saturated_acids") + ", " +
+               scaledSum("carbohydrates") + ", " + scaledSum("sugar") + ", " + scaledSum("protein") + ", " + scaledSum("salt") + ", " +
+               "count(ir.id) - count(i.id)"
+               " from recipe r"
+               " left join ingredient_record ir on ir.recipe_id = r.id"
+               " left join ingredient i on i.id = ir.ingredient_id"
+               " left join " + unitFactorsSql() + " rf on rf.unit_id = ir.unit_id"
+               " left join " + unitFactorsSql() + " inf on inf.unit_id = i.unit_id";
+    }
+};
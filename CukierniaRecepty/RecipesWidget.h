@@ -1,13 +1,25 @@
 #pragma once
 #include <memory>
+#include <algorithm>
 #include <unordered_map>
 #include <Wt/Dbo/Session>
 #include <Wt/WContainerWidget>
 #include <Wt/WBreak>
 #include <Wt/WDialog>
 #include <Wt/WApplication>
+#include <Wt/WTableView>
+#include <Wt/WAnchor>
+#include <Wt/WLink>
 #include "Recipe.h"
+#include "RecipeSummary.h"
+#include "RecipeExportResource.h"
+#include "RecipeSearchIndex.h"
+#include "FirmCatalog.h"
+#include "FirmChanges.h"
+#include "RecipeTotals.h"
+#include "Tracing.h"
 #include "RecipeDetailsWidget.h"
+#include "QueryTableModel.h"
 #include "helpers.h"
 #include "database.h"
 
@@ -27,49 +39,56 @@ class RecipesWidget : public Wt::WContainerWidget {
     Wt::Dbo::dbo_traits<Recipe>::IdType currentRecipe = Wt::Dbo::dbo_traits<Recipe>::invalidId();
 
     RecipesWidget(Wt::WContainerWidget*, Database& db) : db(&db) {
-        Wt::Dbo::Transaction t{db};
-        if(db.users->find(db.login.user())->user()->accessLevel != 0) {
+        if(db.currentUser().canEdit()) {
             addButton = std::make_unique<Wt::WPushButton>("Dodaj przepis", this);
             addButton->clicked().connect(this, &RecipesWidget::showAddDialog);
         }
 
+        // the whole list with ingredient lines, streamed to the browser(see RecipeExportResource)
+        exportResource = std::make_unique<RecipeExportResource>(db.pool(), db.currentUser().firmID, db.currentUser().canEdit());
+        addWidget(new Wt::WAnchor(Wt::WLink(exportResource.get()), "Eksport CSV"));
+        addWidget(new Wt::WAnchor(Wt::WLink(Wt::WLink::Url, exportResource->url() + "&format=json"), "Eksport JSON"));
+
         addWidget(new Wt::WBreak);
         addWidget(new Wt::WLabel("Filtr: "));
         filter = std::make_unique<Wt::WLineEdit>(this);
         filter->setTextSize(filter->text().value().length() + 1);
         filter->setPlaceholderText(L"Część nazwy szukanego przepisu");
-        filter->enterPressed().connect(std::bind([this] {
+        filter->keyWentUp().connect(std::bind([this] {
             populateRecipeList();
         }));
 
-        recipeList = std::make_unique<Wt::WTable>(this);
-        recipeList->addStyleClass("table table-stripped table-bordered");
+        recipeList = std::make_unique<Wt::WTableView>(this);
+        recipeList->setAlternatingRowColors(true);
+        recipeList->setHeight(600);
+        recipeList->setEditTriggers(Wt::WAbstractItemView::SingleClicked);
+        recipeList->clicked().connect(std::bind([this](const Wt::WModelIndex& index) { cellClicked(index); }, std::placeholders::_1));
 
-        populateRecipeList();
+        createModel();
+        changes = FirmChanges::instance().subscribe(db.currentUser().firmID, [this](const FirmChanges::Change& change) { applyChange(change); });
     }
 
     void populateRecipeList() {
-        populateRecipeTable([this](const Wt::Dbo::ptr<Recipe>& recipe) {
-            Wt::Dbo::Transaction t{*db};
-            auto recipeName = std::wstring(recipe->name);
-            return recipe->ownerID == db->users->find(db->login.user())->user()->firmID && recipeName.find(filter->text()) != std::wstring::npos;
-        });
-
-        if(db->users->find(db->login.user())->user()->accessLevel != 0) {
-            makeTableEditable();
-            setupDeleteAction();
+        Tracing::Span span{"RecipesWidget::populateRecipeList"};
+        if (filter->text().empty()) {
+            matches = boost::none;
+        } else {
+            matches = RecipeSearchIndex::instance().search(*db, db->currentUser().firmID, filter->text());
         }
 
-        setupGotoDetails();
+        model->reload();
     }
 
    private:
     Database* db;
     std::unique_ptr<Wt::WLineEdit> filter;
+    boost::optional<std::vector<RecipeSummary::RecipeID>> matches;  // recipes found for the filter, none when it's empty
     bool validFilter = false;
-    std::unique_ptr<Wt::WTable> recipeList;
-    std::unordered_map<int, Wt::Dbo::dbo_traits<Recipe>::IdType> rowToID;
+    std::unique_ptr<QueryTableModel<RecipeSummary>> model;
+    std::unique_ptr<Wt::WTableView> recipeList;
+    std::unique_ptr<RecipeExportResource> exportResource;
     std::unique_ptr<Wt::WPushButton> addButton;
+    FirmChanges::Subscription changes;
 
     void showAddDialog() {
         Wt::WDialog* dialog = new Wt::WDialog("Dodaj przepis");
@@ -99,22 +118,19 @@ class RecipesWidget : public Wt::WContainerWidget {
         ingredientQuantityField->setValidator(ingredientQuantityValidator);
 
         // fill combo box fields and setup combo box index <===> id mappers
-        auto tempIngredientIDs = populateComboBox<Ingredient>(*db, *ingredientField, [](const Ingredient& ingredient) { return ingredient.name; },
-            [this](const Wt::Dbo::ptr<Ingredient>& elem) { return elem->ownerID == db->users->find(db->login.user())->user()->firmID; });
+        auto firmCatalog = FirmCatalog::instance().snapshot(*db, db->currentUser().firmID);
+        auto tempIngredientIDs = populateComboBox(*ingredientField, firmCatalog->ingredients);
         auto ingredientIDs = std::make_shared<std::vector<Wt::Dbo::dbo_traits<Ingredient>::IdType>>(std::move(tempIngredientIDs));
 
         auto unitIDs = std::make_shared<std::vector<Wt::Dbo::dbo_traits<Unit>::IdType>>();
 
         ingredientField->changed().connect(std::bind([=] {
-            auto ingredientID = (*ingredientIDs)[ingredientField->currentIndex()];
+            auto ingredient = firmCatalog->ingredient((*ingredientIDs)[ingredientField->currentIndex()]);
 
             ingredientUnitField->clear();
-            *unitIDs = populateComboBox<Unit>(*db, *ingredientUnitField, [ingredientID](const Unit& unit) { return unit.name; },
-                                              [this, ingredientID](Wt::Dbo::ptr<Unit> potentialUnit) {
-                                                  auto transaction = Wt::Dbo::Transaction(*db);
-                                                  auto ingredient = (Wt::Dbo::ptr<Ingredient>)db->find<Ingredient>().where("id = ?").bind(ingredientID);
-                                                  return Unit::sameBranch(*db, potentialUnit.id(), ingredient->unitID);
-                                              });
+            *unitIDs = populateComboBox(*ingredientUnitField, firmCatalog->units, [&](Wt::Dbo::dbo_traits<Unit>::IdType unitID, const Unit&) {
+                return Unit::sameBranch(firmCatalog->conversions, unitID, ingredient->unitID);
+            });
         }));
 
         ingredientField->changed().emit();
@@ -171,116 +187,171 @@ class RecipesWidget : public Wt::WContainerWidget {
         Wt::Dbo::Transaction transaction(*db);
         auto recipe = db->add(new Recipe);
         recipe.modify()->name = name;
-        recipe.modify()->ownerID = db->users->find(db->login.user())->user()->firmID;
+        recipe.modify()->ownerID = db->currentUser().firmID;
 
+        // ingredients and units could have been deleted since the dialog was opened
+        auto firmCatalog = FirmCatalog::instance().snapshot(*db, recipe->ownerID);
         for (auto row = ingredients.headerCount(); row < ingredients.rowCount(); row++) {
-            Wt::Dbo::ptr<Ingredient> ingredient = db->find<Ingredient>().where("id = ?").bind((*rowToIngredient)[row]);
-            Wt::Dbo::ptr<Unit> unit = db->find<Unit>().where("id = ?").bind((*rowToUnit)[row]);
+            auto ingredientID = firmCatalog->ingredient((*rowToIngredient)[row]) ? (*rowToIngredient)[row] : Wt::Dbo::dbo_traits<Ingredient>::invalidId();
+            auto unitID = firmCatalog->unit((*rowToUnit)[row]) ? (*rowToUnit)[row] : Wt::Dbo::dbo_traits<Unit>::invalidId();
 
             auto ingredientQuantityText = (Wt::WText*)ingredients.elementAt(row, 1)->widget(0);
 
             auto ingredientRecord = db->add(new IngredientRecord);
-            ingredientRecord.modify()->ingredientID = ingredient.id();
-            ingredientRecord.modify()->unitID = unit.id();
+            ingredientRecord.modify()->ingredientID = ingredientID;
+            ingredientRecord.modify()->unitID = unitID;
             ingredientRecord.modify()->quantity = std::stod(ingredientQuantityText->text().narrow());
             ingredientRecord.modify()->recipe = recipe;
         }
+
+        db->flush();
+        RecipeTotals::recipeChanged(*db, recipe->ownerID, recipe.id());
+        transaction.commit();
+
+        RecipeSearchIndex::instance().put(recipe->ownerID, recipe.id(), recipe->name);
+        publish(FirmChanges::Kind::Added, recipe.id());
     }
 
-    void populateRecipeTable(std::function<bool(const Wt::Dbo::ptr<Recipe>& element)> filter) {
-        rowToID.clear();
-        populateTable<Recipe>(*db, *recipeList, [&](const Wt::Dbo::ptr<Recipe>& recipe, int row) {
-            auto transaction = Wt::Dbo::Transaction{*db};
-            rowToID.insert(std::make_pair(row, recipe.id()));
-            std::vector<std::pair<std::wstring, Wt::WString>> columns;
-
-            auto cost = recipe->totalIngredientValue(*db, [](const Ingredient& i) { return i.price; });
-            auto kcal = std::to_wstring(recipe->totalIngredientValue(*db, [](const Ingredient& i) { return i.kcal; }));
-            auto fat = std::to_wstring(recipe->totalIngredientValue(*db, [](const Ingredient& i) { return i.fat; }));
-            auto saturatedAcids = std::to_wstring(recipe->totalIngredientValue(*db, [](const Ingredient& i) { return i.saturatedAcids; }));
-            auto carbohydrates = std::to_wstring(recipe->totalIngredientValue(*db, [](const Ingredient& i) { return i.carbohydrates; }));
-            auto sugar = std::to_wstring(recipe->totalIngredientValue(*db, [](const Ingredient& i) { return i.sugar; }));
-            auto protein = std::to_wstring(recipe->totalIngredientValue(*db, [](const Ingredient& i) { return i.protein; }));
-            auto salt = std::to_wstring(recipe->totalIngredientValue(*db, [](const Ingredient& i) { return i.salt; }));
-
-            columns.emplace_back(colName, recipe->name);
-            if(db->users->find(db->login.user())->user()->accessLevel != 0)
-                columns.emplace_back(colCost, cost == -1 ? L"Błąd, nie można obliczyć kosztu" : std::to_wstring(cost));
-
-            columns.emplace_back(colKcal, kcal);
-            columns.emplace_back(colFats, fat);
-            columns.emplace_back(colSatAcids, saturatedAcids);
-            columns.emplace_back(colCarbs, carbohydrates);
-            columns.emplace_back(colSugar, sugar);
-            columns.emplace_back(colProtein, protein);
-            columns.emplace_back(colSalt, salt);
-
-            if(db->users->find(db->login.user())->user()->accessLevel != 0)
-                columns.emplace_back(colDelete, "X");
-
-            return columns;
-        }, filter);
+    void publish(FirmChanges::Kind kind, Wt::Dbo::dbo_traits<Recipe>::IdType id) {
+        FirmChanges::instance().publish(db->currentUser().firmID, {FirmChanges::Entity::Recipe, kind, id}, changes);
     }
 
-    void makeTableEditable() {
-        makeTextCellsInteractive(*recipeList, colName, [this](int row, const Wt::WLineEdit& editField, Wt::WString oldContent) {
-            if (Wt::WValidator(true).validate(editField.text()).state() != Wt::WValidator::Valid) {
-                return oldContent;
-            }
+    // change made by another widget(or session); recipe details report their changes as changes of the recipe
+    void applyChange(const FirmChanges::Change& change) {
+        if (change.entity == FirmChanges::Entity::Recipe) {
+            if (change.kind == FirmChanges::Kind::Removed) {
+                if (matches)
+                    matches->erase(std::remove(matches->begin(), matches->end(), change.id), matches->end());
 
-            auto transaction = Wt::Dbo::Transaction(*db);
-            auto recipe = (Wt::Dbo::ptr<Recipe>)db->find<Recipe>().where("id = ?").bind(rowToID[row]);
-            recipe.modify()->name = editField.text();
-            return Wt::WString(editField.text());
-        });
+                model->removeRecord(change.id);
+            } else if (change.kind == FirmChanges::Kind::Added || matches) {
+                populateRecipeList();  // position of the row is unknown, renamed recipe may not match the filter anymore
+            } else {
+                model->refreshRecord(change.id);
+            }
+        } else if ((change.entity == FirmChanges::Entity::Ingredient || change.entity == FirmChanges::Entity::Unit) &&
+                   change.kind != FirmChanges::Kind::Added) {
+            // totals of any recipe may depend on them
+            model->refreshAll();
+        }
     }
 
-    void setupDeleteAction() {
-        auto column = findColumn(*recipeList, colDelete);
-        if (column == -1)
-            return;
+    void createModel() {
+        auto editable = db->currentUser().canEdit();
+
+        auto number = [](double value) { return Wt::WString(std::to_wstring(value)); };
+
+        std::vector<QueryTableModel<RecipeSummary>::Column> columns;
+        columns.push_back({colName, [](const RecipeSummary& recipe) { return recipe.name; }, "r.name",
+                           editable ? [this](const RecipeSummary& recipe, const boost::any& value) { return rename(recipe.id, Wt::asString(value)); }
+                                    : std::function<bool(const RecipeSummary&, const boost::any&)>()});
+        if (editable)
+            columns.push_back({colCost, [=](const RecipeSummary& recipe) {
+                                   return !recipe.totals.valid ? Wt::WString(L"Błąd, nie można obliczyć kosztu") : number(recipe.totals.price);
+                               }, "total_price"});
+
+        columns.push_back({colKcal, [=](const RecipeSummary& recipe) { return number(recipe.totals.kcal); }, "total_kcal"});
+        columns.push_back({colFats, [=](const RecipeSummary& recipe) { return number(recipe.totals.fat); }, "total_fat"});
+        columns.push_back({colSatAcids, [=](const RecipeSummary& recipe) { return number(recipe.totals.saturatedAcids); }, "total_saturated_acids"});
+        columns.push_back({colCarbs, [=](const RecipeSummary& recipe) { return number(recipe.totals.carbohydrates); }, "total_carbohydrates"});
+        columns.push_back({colSugar, [=](const RecipeSummary& recipe) { return number(recipe.totals.sugar); }, "total_sugar"});
+        columns.push_back({colProtein, [=](const RecipeSummary& recipe) { return number(recipe.totals.protein); }, "total_protein"});
+        columns.push_back({colSalt, [=](const RecipeSummary& recipe) { return number(recipe.totals.salt); }, "total_salt"});
+
+        if (editable)
+            columns.push_back({colDelete, [](const RecipeSummary&) { return Wt::WString("X"); }, ""});
+
+        columns.push_back({colDetails, [](const RecipeSummary&) { return Wt::WString(L"Szczegóły"); }, ""});
+
+        // matches are read on every fetch, so changing the filter needs only populateRecipeList()
+        model = std::make_unique<QueryTableModel<RecipeSummary>>(
+            std::move(columns),
+            [this] { return RecipeSummary::count(*db, db->currentUser().firmID, matches); },
+            [this](int offset, int limit, const std::string& orderBy) {
+                Tracing::Span span{"RecipesWidget::fetchRecipes"};
+                return RecipeSummary::load(*db, db->currentUser().firmID, matches, orderBy, offset, limit);
+            },
+            [this](Wt::Dbo::dbo_traits<Recipe>::IdType id) { return RecipeSummary::find(*db, db->currentUser().firmID, id); },
+            [](const RecipeSummary& recipe) { return recipe.id; },
+            "r.name");
+
+        recipeList->setModel(model.get());
+        for (auto column = 0; column < model->columnCount(); column++) {
+            recipeList->setSortingEnabled(column, column != model->columnOf(colDelete) && column != model->columnOf(colDetails));
+        }
+    }
 
-        for (auto row = recipeList->headerCount(); row < recipeList->rowCount(); row++) {
-            recipeList->elementAt(row, column)->clicked().connect(std::bind([this, row] {
-                auto confirmationDialog = new Wt::WDialog(L"Potwierdzenie usunięcia przepisu");
-                auto yesButton = new Wt::WPushButton("Tak", confirmationDialog->footer());
-                auto noButton = new Wt::WPushButton("Nie", confirmationDialog->footer());
-                new Wt::WText(L"Czy napewno usunąć przepis?", confirmationDialog->contents());
-                yesButton->clicked().connect(confirmationDialog, &Wt::WDialog::accept);
-                noButton->clicked().connect(confirmationDialog, &Wt::WDialog::reject);
-                confirmationDialog->rejectWhenEscapePressed();
-
-                confirmationDialog->finished().connect(std::bind([this, confirmationDialog, row] {
-                    if (confirmationDialog->result() != Wt::WDialog::Accepted)
-                        return;
-
-                    Wt::Dbo::Transaction transaction(*db);
-
-                    auto recipe = (Wt::Dbo::ptr<Recipe>)db->find<Recipe>().where("id = ?").bind(rowToID[row]);
-                    recipe.modify()->ingredientRecords.clear();
-                    recipe.remove();
-                    populateRecipeList();
-                    delete confirmationDialog;
-                }));
+    bool rename(Wt::Dbo::dbo_traits<Recipe>::IdType id, const Wt::WString& name) {
+        if (Wt::WValidator(true).validate(name).state() != Wt::WValidator::Valid) {
+            return false;
+        }
 
-                confirmationDialog->show();
-            }));
+        auto transaction = Wt::Dbo::Transaction(*db);
+        auto recipe = (Wt::Dbo::ptr<Recipe>)db->find<Recipe>().where("id = ?").bind(id);
+        if (recipe.id() == Wt::Dbo::dbo_traits<Recipe>::invalidId()) {
+            showRemovedMeanwhile();  // the row goes away with the change of the other session
+            return false;
         }
+
+        recipe.modify()->name = name;
+        transaction.commit();
+
+        RecipeSearchIndex::instance().put(recipe->ownerID, id, name);
+        publish(FirmChanges::Kind::Changed, id);
+        return true;
     }
 
-    void setupGotoDetails() {
-        auto column = findColumn(*recipeList, colDetails);
-        if (column == -1) {
-            column = recipeList->columnCount();
-            recipeList->setHeaderCount(1);
-            recipeList->elementAt(0, column)->addWidget(new Wt::WText(colDetails));
+    void cellClicked(const Wt::WModelIndex& index) {
+        if (!index.isValid())
+            return;
+
+        auto id = model->idAt(index.row());
+        if (index.column() == model->columnOf(colDetails)) {
+            currentRecipe = id;
+            Wt::WApplication::instance()->setInternalPath("/recipe", true);
+        } else if (index.column() == model->columnOf(colDelete)) {
+            confirmDelete(id);
         }
+    }
+
+    static void showRemovedMeanwhile() {
+        showMessageDialog(L"Przepis nie istnieje", L"Przepis został w międzyczasie usunięty.");
+    }
+
+    void confirmDelete(Wt::Dbo::dbo_traits<Recipe>::IdType id) {
+        auto confirmationDialog = new Wt::WDialog(L"Potwierdzenie usunięcia przepisu");
+        auto yesButton = new Wt::WPushButton("Tak", confirmationDialog->footer());
+        auto noButton = new Wt::WPushButton("Nie", confirmationDialog->footer());
+        new Wt::WText(L"Czy napewno usunąć przepis?", confirmationDialog->contents());
+        yesButton->clicked().connect(confirmationDialog, &Wt::WDialog::accept);
+        noButton->clicked().connect(confirmationDialog, &Wt::WDialog::reject);
+        confirmationDialog->rejectWhenEscapePressed();
+
+        confirmationDialog->finished().connect(std::bind([this, confirmationDialog, id] {
+            if (confirmationDialog->result() == Wt::WDialog::Accepted) {
+                Wt::Dbo::Transaction transaction(*db);
+
+                auto recipe = (Wt::Dbo::ptr<Recipe>)db->find<Recipe>().where("id = ?").bind(id);
+                if (recipe.id() == Wt::Dbo::dbo_traits<Recipe>::invalidId()) {
+                    showRemovedMeanwhile();
+                    delete confirmationDialog;
+                    return;
+                }
+
+                auto firmID = recipe->ownerID;
+                recipe.modify()->ingredientRecords.clear();
+                recipe.remove();
+                RecipeTotals::recipeRemoved(*db, id);
+                transaction.commit();
+
+                RecipeSearchIndex::instance().remove(firmID, id);
+                publish(FirmChanges::Kind::Removed, id);
+                model->removeRecord(id);
+            }
 
-        for (auto row = recipeList->headerCount(); row < recipeList->rowCount(); row++) {
-            auto link = new Wt::WAnchor(Wt::WLink(Wt::WLink::InternalPath, "/recipe"), L"Szczegóły");
-            link->clicked().connect(std::bind([row, this] { currentRecipe = rowToID[row]; }));
+            delete confirmationDialog;
+        }));
 
-            recipeList->elementAt(row, recipeList->columnCount() - 1)->addWidget(link);
-        }
+        confirmationDialog->show();
     }
 };
@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <Wt/WString>
+#include <Wt/Dbo/Dbo>
+#include <Wt/Dbo/WtSqlTraits>
+#include "database.h"
+#include "Unit.h"
+#include "Ingredient.h"
+
+// Which records still refer to an ingredient or a unit, e.g. before deleting it.
+// Every check is one query on an indexed foreign key column(see indexes() of the classes), nothing is scanned.
+class References {
+   public:
+    using IngredientID = Wt::Dbo::dbo_traits<Ingredient>::IdType;
+    using UnitID = Wt::Dbo::dbo_traits<Unit>::IdType;
+
+    // names of at most limit recipes, empty if the ingredient isn't used
+    static std::vector<Wt::WString> recipesUsingIngredient(Database& db, IngredientID ingredientID, int limit = 1) {
+        return names(db, "select distinct r.name from ingredient_record ir join recipe r on r.id = ir.recipe_id", "ir.ingredient_id = ?", ingredientID, limit);
+    }
+
+    static std::vector<Wt::WString> recipesUsingUnit(Database& db, UnitID unitID, int limit = 1) {
+        return names(db, "select distinct r.name from ingredient_record ir join recipe r on r.id = ir.recipe_id", "ir.unit_id = ?", unitID, limit);
+    }
+
+    static std::vector<Wt::WString> ingredientsUsingUnit(Database& db, UnitID unitID, int limit = 1) {
+        return names(db, "select name from ingredient", "unit_id = ?", unitID, limit);
+    }
+
+    static std::vector<Wt::WString> unitsBasedOn(Database& db, UnitID unitID, int limit = 1) {
+        return names(db, "select name from unit", "base_unit_id = ?", unitID, limit);
+    }
+
+   private:
+    static std::vector<Wt::WString> names(Database& db, const std::string& select, const std::string& condition, long long id, int limit) {
+        Wt::Dbo::Transaction transaction{db};
+        Wt::Dbo::collection<Wt::WString> rows = db.query<Wt::WString>(select).where(condition).bind(id).limit(limit);
+        return std::vector<Wt::WString>(rows.begin(), rows.end());
+    }
+};
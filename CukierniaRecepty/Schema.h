@@ -0,0 +1,116 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <Wt/Dbo/Dbo>
+#include <Wt/Dbo/Exception>
+#include "database.h"
+#include "User.h"
+#include "Unit.h"
+#include "Ingredient.h"
+#include "Recipe.h"
+#include "SchemaIndex.h"
+#include "RecipeTotals.h"
+
+// Mapping of persisted classes and versioned changes of the database schema.
+// Migrations run once, from main() before the server starts, so sessions only have to map classes.
+class Schema {
+   public:
+    struct Migration {
+        int version;
+        std::string description;
+        std::function<void(Database&)> apply;
+    };
+
+    static void mapClasses(Wt::Dbo::Session& session) {
+        session.mapClass<Ingredient>("ingredient");
+        session.mapClass<Unit>("unit");
+        session.mapClass<Recipe>("recipe");
+        session.mapClass<IngredientRecord>("ingredient_record");
+        session.mapClass<User>("user");
+        session.mapClass<AuthInfo>("auth_info");
+        session.mapClass<AuthInfo::AuthIdentityType>("auth_identity");
+        session.mapClass<AuthInfo::AuthTokenType>("auth_token");
+    }
+
+    // Ordered list of all schema changes. Append new steps at the end, never change or remove applied ones.
+    static std::vector<Migration> migrations() {
+        return {
+            {1, "initial schema", [](Database& db) { db.createTables(); }},
+            {2, "secondary indexes", [](Database& db) {
+                 createIndexes(db, "unit", Unit::indexes());
+                 createIndexes(db, "ingredient", Ingredient::indexes());
+                 createIndexes(db, "recipe", Recipe::indexes());
+                 createIndexes(db, "ingredient_record", IngredientRecord::indexes());
+             }},
+            {3, "materialized recipe totals", [](Database& db) {
+                 RecipeTotals::createTable(db);
+                 RecipeTotals::rebuild(db);
+             }},
+        };
+    }
+
+    static void migrate(Database& db) {
+        {
+            Wt::Dbo::Transaction transaction{db};
+            db.execute("create table if not exists schema_version (version integer not null, description varchar(255) not null)");
+        }
+
+        auto current = currentVersion(db);
+
+        // databases created before schema versioning already have the initial tables
+        if (current == 0 && tableExists(db, "recipe")) {
+            Wt::Dbo::Transaction transaction{db};
+            Wt::log("notice") << "Schema: found tables created without versioning, marking them as version 1";
+            db.execute("insert into schema_version (version, description) values (?, ?)").bind(1).bind(std::string("initial schema"));
+            current = 1;
+        }
+
+        for (const auto& migration : migrations()) {
+            if (migration.version <= current) {
+                continue;
+            }
+
+            Wt::Dbo::Transaction transaction{db};
+            Wt::log("notice") << "Schema: migrating to version " << migration.version << " (" << migration.description << ")";
+            migration.apply(db);
+            db.execute("insert into schema_version (version, description) values (?, ?)").bind(migration.version).bind(migration.description);
+            current = migration.version;
+        }
+
+        Wt::log("notice") << "Schema: database is at version " << current;
+    }
+
+   private:
+    static void createIndexes(Database& db, const std::string& table, const std::vector<SchemaIndex>& indexes) {
+        for (const auto& index : indexes) {
+            if (index.foreignKey && db.dialect().indexesForeignKeys())
+                continue;
+
+            auto columns = std::string{};
+            for (const auto& column : index.columns) {
+                columns += (columns.empty() ? "" : ", ") + db.dialect().indexColumn(column);
+            }
+
+            db.execute("create index " + index.name + " on " + table + " (" + columns + ")");
+        }
+    }
+
+    static int currentVersion(Database& db) {
+        Wt::Dbo::Transaction transaction{db};
+        int version = db.query<int>("select coalesce(max(version), 0) from schema_version");
+        return version;
+    }
+
+    // has to run outside of other transactions, failed statement would abort them
+    static bool tableExists(Database& db, const std::string& table) {
+        try {
+            Wt::Dbo::Transaction transaction{db};
+            int rows = db.query<int>("select count(1) from " + table);
+            (void)rows;
+            return true;
+        } catch (const Wt::Dbo::Exception&) {
+            return false;
+        }
+    }
+};
@@ -0,0 +1,12 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Secondary index of a persisted class. Dbo can't declare indexes in persist(), so classes list them in a static indexes()
+// right next to it and Schema creates them in a migration. Text columns need a prefix length, e.g. "name(64)", which is dropped
+// on backends indexing whole values(SqlDialect::indexColumn). MySQL can't sort by a prefix index, it only finds the rows with it.
+struct SchemaIndex {
+    std::string name;
+    std::vector<std::string> columns;
+    bool foreignKey = false;  // column of a belongsTo(), skipped on backends which index foreign keys themselves(SqlDialect::indexesForeignKeys)
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <string>
+#include <Wt/WApplication>
+#include <Wt/WEnvironment>
+#include <Wt/Auth/AuthService>
+#include <Wt/Auth/HashFunction>
+#include <Wt/Auth/User>
+#include "database.h"
+#include "TokenCache.h"
+
+// Login with the auth token cookie("logincookie") of a new session, like AuthWidget::processEnvironment does, but through TokenCache.
+// On a cache hit the session is logged in without touching the database. On a miss the token is processed(and rotated) by
+// AuthService, and the new token is cached for the next tab.
+class SessionResume {
+   public:
+    // false if there's no token, then the environment is left to AuthWidget::processEnvironment
+    static bool fromCookie(Database& db) {
+        const auto& auth = Database::auth();
+        auto app = Wt::WApplication::instance();
+        auto token = app->environment().getCookieValue(auth.authTokenCookieName());
+        if (!auth.authTokensEnabled() || !token || token->empty())
+            return false;
+
+        auto tokenHash = hash(*token);
+        if (auto cached = TokenCache::instance().find(tokenHash)) {
+            db.setResumedUser(cached->userID, cached->user);
+            db.login.login(Wt::Auth::User(cached->userID, *db.users), Wt::Auth::WeakLogin);
+            db.authTokenHash = tokenHash;
+            return true;
+        }
+
+        auto user = Wt::Auth::User{};
+        {
+            Wt::Dbo::Transaction transaction{db};
+            auto result = auth.processAuthToken(*token, *db.users);
+            if (result.result() != Wt::Auth::AuthTokenResult::Valid) {
+                app->removeCookie(auth.authTokenCookieName(), auth.authTokenCookieDomain());
+                return true;
+            }
+
+            user = result.user();
+            auto newHash = tokenHash;
+            if (!result.newToken().empty()) {
+                app->setCookie(auth.authTokenCookieName(), result.newToken(), result.newTokenValidity(), auth.authTokenCookieDomain(), "",
+                               app->environment().urlScheme() == "https");
+                newHash = hash(result.newToken());
+                TokenCache::instance().remove(tokenHash);
+            }
+
+            // a user without its UserData row isn't cached, same check as in Database::refreshCurrentUser
+            auto info = db.users->find(user);
+            auto userData = info ? info->user() : Wt::Dbo::ptr<User>{};
+            if (user.status() == Wt::Auth::User::Normal && userData.id() != Wt::Dbo::dbo_traits<User>::invalidId())
+                TokenCache::instance().put(newHash, user.id(), CurrentUser{true, userData->firmID, userData->accessLevel});
+            db.authTokenHash = newHash;
+        }
+
+        db.login.login(user, Wt::Auth::WeakLogin);
+        return true;
+    }
+
+    // token of the session is dropped from the cache, the database and the browser, so that the next tab doesn't log in again
+    static void logout(Database& db) {
+        if (!db.authTokenHash.empty() && db.login.loggedIn()) {
+            TokenCache::instance().remove(db.authTokenHash);
+
+            Wt::Dbo::Transaction transaction{db};
+            db.users->removeAuthToken(db.login.user(), db.authTokenHash);
+        }
+        db.authTokenHash.clear();
+
+        const auto& auth = Database::auth();
+        if (auth.authTokensEnabled())
+            Wt::WApplication::instance()->removeCookie(auth.authTokenCookieName(), auth.authTokenCookieDomain());
+
+        db.login.logout();
+    }
+
+   private:
+    static std::string hash(const std::string& token) {
+        return Database::auth().tokenHashFunction()->compute(token, "");
+    }
+};
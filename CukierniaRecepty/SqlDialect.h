@@ -0,0 +1,77 @@
+#pragma once
+#include <string>
+#include <boost/optional.hpp>
+
+// Differences between database backends, for the raw SQL which Dbo doesn't generate itself(indexes, recipe_totals).
+// Everything else(limit/offset, quoting of names, autoincrement) is done by Dbo for each backend already.
+// Raw SQL should stay within what all three backends share, e.g. "with recursive" needs MySQL 8.0 or newer.
+class SqlDialect {
+   public:
+    enum class Backend { MySQL, SQLite, Postgres };
+
+    explicit SqlDialect(Backend backend = Backend::MySQL) : backendType(backend) {}
+
+    // name as used in the db-backend property, none if it's unknown
+    static boost::optional<SqlDialect> fromName(const std::string& name) {
+        if (name == "mysql")
+            return SqlDialect{Backend::MySQL};
+        if (name == "sqlite")
+            return SqlDialect{Backend::SQLite};
+        if (name == "postgres")
+            return SqlDialect{Backend::Postgres};
+
+        return boost::none;
+    }
+
+    Backend backend() const {
+        return backendType;
+    }
+
+    std::string name() const {
+        switch (backendType) {
+            case Backend::MySQL:
+                return "mysql";
+            case Backend::SQLite:
+                return "sqlite";
+            case Backend::Postgres:
+                return "postgres";
+        }
+
+        return "";
+    }
+
+    // 0 for SQLite, which is a file
+    int defaultPort() const {
+        switch (backendType) {
+            case Backend::MySQL:
+                return 3306;
+            case Backend::Postgres:
+                return 5432;
+            case Backend::SQLite:
+                break;
+        }
+
+        return 0;
+    }
+
+    // column of an index, MySQL needs a prefix length for text columns(e.g. "name(64)"), the others index the whole value
+    std::string indexColumn(const std::string& column) const {
+        if (backendType == Backend::MySQL)
+            return column;
+
+        return column.substr(0, column.find('('));
+    }
+
+    // InnoDB creates an index for every foreign key, SQLite and PostgreSQL don't
+    bool indexesForeignKeys() const {
+        return backendType == Backend::MySQL;
+    }
+
+    // placeholders one statement may have, e.g. for multi-row inserts; SQLite older than 3.32 allows only 999
+    int maxBindParameters() const {
+        return backendType == Backend::SQLite ? 999 : 65535;
+    }
+
+   private:
+    Backend backendType;
+};
@@ -0,0 +1,459 @@
+#pragma once
+#include <cctype>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <Wt/WLogger>
+#include <Wt/Dbo/SqlConnection>
+#include <Wt/Dbo/SqlStatement>
+#include "Metrics.h"
+#include "Tracing.h"
+
+// Counts and times every statement sent through a pooled connection. ConnectionPool wraps its connections in SqlMetrics::Connection,
+// so Dbo and raw SQL(Database::execute) are both seen. Statements are reported to Metrics by template(literals replaced with ?),
+// to the transaction of the connection(slow ones are logged with their statements) and to the RequestScope of the thread, if any.
+// In requests sampled by Tracing statements and transactions are spans too.
+namespace SqlMetrics {
+
+using Clock = std::chrono::steady_clock;
+
+inline double seconds(Clock::duration duration) {
+    return std::chrono::duration<double>(duration).count();
+}
+
+inline Metrics::Histogram& statementSeconds() {
+    static auto& histogram = Metrics::instance().histogram("bakery_sql_statement_seconds", "Time of SQL statements, including reading of their rows.",
+                                                           "statement", {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5});
+    return histogram;
+}
+
+inline Metrics::Histogram& transactionSeconds() {
+    static auto& histogram = Metrics::instance().histogram("bakery_sql_transaction_seconds", "Time from start to commit or rollback of transactions.",
+                                                           "outcome", {0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10});
+    return histogram;
+}
+
+inline Metrics::Histogram& statementsPerRequest() {
+    static auto& histogram = Metrics::instance().histogram("bakery_sql_statements_per_request", "SQL statements made while handling one request, by page.",
+                                                           "page", {0, 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000});
+    return histogram;
+}
+
+inline Metrics::Histogram& secondsPerRequest() {
+    static auto& histogram = Metrics::instance().histogram("bakery_sql_seconds_per_request", "Time of SQL statements made while handling one request, by page.",
+                                                           "page", {0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5});
+    return histogram;
+}
+
+// statement with numbers and strings replaced by ?, and lists of them(e.g. "in (1, 2, 3)") by a single one, so that statements
+// differing only in ids built into them(RecipeTotals, RecipeSummary) have one template
+inline std::string statementTemplate(const std::string& sql) {
+    auto result = std::string{};
+    for (auto i = 0u; i < sql.size(); i++) {
+        auto c = sql[i];
+        auto literal = false;
+        if (c == '\'') {
+            for (i++; i < sql.size() && !(sql[i] == '\'' && (i + 1 == sql.size() || sql[i + 1] != '\'')); i += sql[i] == '\'' ? 2 : 1) {
+            }
+            literal = true;
+        } else if (std::isdigit(static_cast<unsigned char>(c)) && (result.empty() || !(std::isalnum(static_cast<unsigned char>(result.back())) || result.back() == '_'))) {
+            while (i + 1 < sql.size() && (std::isdigit(static_cast<unsigned char>(sql[i + 1])) || sql[i + 1] == '.')) {
+                i++;
+            }
+            literal = true;
+        } else if (std::isspace(static_cast<unsigned char>(c))) {
+            if (!result.empty() && result.back() != ' ')
+                result += ' ';
+            continue;
+        }
+
+        if (!literal && c != '?') {
+            result += c;
+            continue;
+        }
+
+        // "?, ?" becomes "?"
+        auto end = result.size();
+        while (end > 0 && result[end - 1] == ' ') {
+            end--;
+        }
+        if (end >= 3 && result.compare(end - 3, 3, "?, ") == 0)
+            result.resize(end - 1);
+        else if (end >= 2 && result.compare(end - 2, 2, "?,") == 0)
+            result.resize(end - 1);
+        else
+            result += '?';
+    }
+
+    return result;
+}
+
+// statements of the current request, set up by App around the handling of every request
+class RequestScope {
+   public:
+    // totals of a whole session, kept by App and logged when the session ends
+    struct Totals {
+        unsigned long long statements = 0;
+        Clock::duration time = Clock::duration::zero();
+    };
+
+    explicit RequestScope(Totals& session) : session(session), previous(current()) {
+        current() = this;
+    }
+
+    RequestScope(const RequestScope&) = delete;
+    RequestScope& operator=(const RequestScope&) = delete;
+
+    ~RequestScope() {
+        current() = previous;
+    }
+
+    // page is e.g. the internal path at the end of the request
+    void finish(const std::string& page) {
+        statementsPerRequest().observe(page, static_cast<double>(statements));
+        secondsPerRequest().observe(page, seconds(time));
+        session.statements += statements;
+        session.time += time;
+    }
+
+    static void record(Clock::duration duration) {
+        if (auto* scope = current()) {
+            scope->statements++;
+            scope->time += duration;
+        }
+    }
+
+   private:
+    // sessions are handled by one thread at a time, so the request of a statement is the one of its thread
+    static RequestScope*& current() {
+        static thread_local RequestScope* scope = nullptr;
+        return scope;
+    }
+
+    Totals& session;
+    RequestScope* previous;
+    unsigned long long statements = 0;
+    Clock::duration time = Clock::duration::zero();
+};
+
+class Connection;
+
+// measures from execute() until its rows are read(or the statement is reset or executed again)
+class Statement : public Wt::Dbo::SqlStatement {
+   public:
+    Statement(std::unique_ptr<Wt::Dbo::SqlStatement> statement, Connection& connection)
+        : statement(std::move(statement)), connection(connection),
+          statementTemplate(std::make_shared<const std::string>(SqlMetrics::statementTemplate(this->statement->sql()))) {}
+
+    ~Statement() override {
+        finish();
+    }
+
+    void reset() override {
+        finish();
+        statement->reset();
+    }
+
+    void bind(int column, const std::string& value) override {
+        statement->bind(column, value);
+    }
+
+    void bind(int column, short value) override {
+        statement->bind(column, value);
+    }
+
+    void bind(int column, int value) override {
+        statement->bind(column, value);
+    }
+
+    void bind(int column, long long value) override {
+        statement->bind(column, value);
+    }
+
+    void bind(int column, float value) override {
+        statement->bind(column, value);
+    }
+
+    void bind(int column, double value) override {
+        statement->bind(column, value);
+    }
+
+    void bind(int column, const boost::posix_time::ptime& value, Wt::Dbo::SqlDateTimeType type) override {
+        statement->bind(column, value, type);
+    }
+
+    void bind(int column, const boost::posix_time::time_duration& value) override {
+        statement->bind(column, value);
+    }
+
+    void bind(int column, const std::vector<unsigned char>& value) override {
+        statement->bind(column, value);
+    }
+
+    void bindNull(int column) override {
+        statement->bindNull(column);
+    }
+
+    void execute() override {
+        finish();
+        running = true;
+        started = Clock::now();
+        elapsed = Clock::duration::zero();
+        measure([this] { statement->execute(); });
+    }
+
+    long long insertedId() override {
+        return statement->insertedId();
+    }
+
+    int affectedRowCount() override {
+        return statement->affectedRowCount();
+    }
+
+    bool nextRow() override {
+        auto row = false;
+        measure([this, &row] { row = statement->nextRow(); });
+        if (!row)
+            finish();
+
+        return row;
+    }
+
+    int columnCount() const override {
+        return statement->columnCount();
+    }
+
+    bool getResult(int column, std::string* value, int size) override {
+        return statement->getResult(column, value, size);
+    }
+
+    bool getResult(int column, short* value) override {
+        return statement->getResult(column, value);
+    }
+
+    bool getResult(int column, int* value) override {
+        return statement->getResult(column, value);
+    }
+
+    bool getResult(int column, long long* value) override {
+        return statement->getResult(column, value);
+    }
+
+    bool getResult(int column, float* value) override {
+        return statement->getResult(column, value);
+    }
+
+    bool getResult(int column, double* value) override {
+        return statement->getResult(column, value);
+    }
+
+    bool getResult(int column, boost::posix_time::ptime* value, Wt::Dbo::SqlDateTimeType type) override {
+        return statement->getResult(column, value, type);
+    }
+
+    bool getResult(int column, boost::posix_time::time_duration* value) override {
+        return statement->getResult(column, value);
+    }
+
+    bool getResult(int column, std::vector<unsigned char>* value, int size) override {
+        return statement->getResult(column, value, size);
+    }
+
+    std::string sql() const override {
+        return statement->sql();
+    }
+
+   private:
+    template <typename Function>
+    void measure(Function function) {
+        auto start = Clock::now();
+        try {
+            function();
+        } catch (...) {
+            elapsed += Clock::now() - start;
+            finish();
+            throw;
+        }
+        elapsed += Clock::now() - start;
+    }
+
+    void finish();
+
+    std::unique_ptr<Wt::Dbo::SqlStatement> statement;
+    Connection& connection;
+    const std::shared_ptr<const std::string> statementTemplate;  // shared with the log of the transaction, which may outlive the statement
+    bool running = false;
+    Clock::time_point started;
+    Clock::duration elapsed = Clock::duration::zero();
+};
+
+// forwards everything to the backend connection, keeps track of the running transaction
+class Connection : public Wt::Dbo::SqlConnection {
+   public:
+    Connection(std::unique_ptr<Wt::Dbo::SqlConnection> connection, std::chrono::milliseconds slowTransaction)
+        : SqlConnection(*connection), connection(std::move(connection)), slowTransaction(slowTransaction) {}
+
+    ~Connection() override {
+        clearStatementCache();  // cached statements refer to this connection
+    }
+
+    Wt::Dbo::SqlConnection* clone() const override {
+        return new Connection(std::unique_ptr<Wt::Dbo::SqlConnection>(connection->clone()), slowTransaction);
+    }
+
+    void startTransaction() override {
+        connection->startTransaction();
+        transactionStart = Clock::now();
+        statements.clear();
+        statementCount = 0;
+    }
+
+    void commitTransaction() override {
+        connection->commitTransaction();
+        transactionFinished("commit");
+    }
+
+    void rollbackTransaction() override {
+        connection->rollbackTransaction();
+        transactionFinished("rollback");
+    }
+
+    Wt::Dbo::SqlStatement* prepareStatement(const std::string& sql) override {
+        return new Statement(std::unique_ptr<Wt::Dbo::SqlStatement>(connection->prepareStatement(sql)), *this);
+    }
+
+    std::string autoincrementType() const override {
+        return connection->autoincrementType();
+    }
+
+    std::string autoincrementSql() const override {
+        return connection->autoincrementSql();
+    }
+
+    std::vector<std::string> autoincrementCreateSequence(const std::string& table, const std::string& id) const override {
+        return connection->autoincrementCreateSequence(table, id);
+    }
+
+    std::vector<std::string> autoincrementDropSequence(const std::string& table, const std::string& id) const override {
+        return connection->autoincrementDropSequence(table, id);
+    }
+
+    std::string autoincrementInsertInfix(const std::string& id) const override {
+        return connection->autoincrementInsertInfix(id);
+    }
+
+    std::string autoincrementInsertSuffix(const std::string& id) const override {
+        return connection->autoincrementInsertSuffix(id);
+    }
+
+    const char* dateTimeType(Wt::Dbo::SqlDateTimeType type) const override {
+        return connection->dateTimeType(type);
+    }
+
+    const char* blobType() const override {
+        return connection->blobType();
+    }
+
+    std::string textType(int size) const override {
+        return connection->textType(size);
+    }
+
+    std::string longLongType() const override {
+        return connection->longLongType();
+    }
+
+    const char* booleanType() const override {
+        return connection->booleanType();
+    }
+
+    bool supportAlterTable() const override {
+        return connection->supportAlterTable();
+    }
+
+    bool supportDeferrableFKConstraint() const override {
+        return connection->supportDeferrableFKConstraint();
+    }
+
+    const char* alterTableConstraintString() const override {
+        return connection->alterTableConstraintString();
+    }
+
+    bool requireSubqueryAlias() const override {
+        return connection->requireSubqueryAlias();
+    }
+
+    bool usesRowsFromTo() const override {
+        return connection->usesRowsFromTo();
+    }
+
+    Wt::Dbo::LimitQuery limitQueryMethod() const override {
+        return connection->limitQueryMethod();
+    }
+
+    bool supportUpdateCascade() const override {
+        return connection->supportUpdateCascade();
+    }
+
+    void prepareForDropTables() override {
+        connection->prepareForDropTables();
+    }
+
+   private:
+    friend class Statement;
+
+    struct Executed {
+        std::shared_ptr<const std::string> statementTemplate;
+        Clock::duration time;
+    };
+
+    static constexpr std::size_t maxLoggedStatements = 50;
+
+    void statementFinished(const std::shared_ptr<const std::string>& statementTemplate, Clock::duration time) {
+        statementSeconds().observe(*statementTemplate, seconds(time));
+        RequestScope::record(time);
+        if (statements.size() < maxLoggedStatements)
+            statements.push_back(Executed{statementTemplate, time});
+        statementCount++;
+    }
+
+    void transactionFinished(const std::string& outcome) {
+        auto end = Clock::now();
+        auto time = end - transactionStart;
+        transactionSeconds().observe(outcome, seconds(time));
+        if (Tracing::sampling())
+            Tracing::record("transaction " + outcome, transactionStart, end);  // the name is built only for sampled requests
+
+        if (time >= slowTransaction) {
+            auto log = Wt::log("warning");
+            log << "SqlMetrics: slow transaction(" << outcome << ") took " << std::chrono::duration_cast<std::chrono::milliseconds>(time).count() << "ms, "
+                << statementCount << " statements:";
+            for (const auto& statement : statements) {
+                log << "\n  " << std::chrono::duration_cast<std::chrono::microseconds>(statement.time).count() << "us " << *statement.statementTemplate;
+            }
+            if (statementCount > statements.size())
+                log << "\n  ... " << statementCount - statements.size() << " more";
+        }
+
+        statements.clear();
+        statementCount = 0;
+    }
+
+    std::unique_ptr<Wt::Dbo::SqlConnection> connection;
+    const std::chrono::milliseconds slowTransaction;
+    Clock::time_point transactionStart = Clock::now();
+    std::vector<Executed> statements;
+    std::size_t statementCount = 0;
+};
+
+inline void Statement::finish() {
+    if (!running)
+        return;
+
+    running = false;
+    connection.statementFinished(statementTemplate, elapsed);
+    if (Tracing::sampling())
+        Tracing::record("sql " + *statementTemplate, started, Clock::now());
+}
+
+}  // namespace SqlMetrics
@@ -0,0 +1,70 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <Wt/WJavaScript>
+#include <Wt/WTable>
+#include <Wt/WTableCell>
+
+// Clicks on cells of a WTable handled by the table itself: browser finds the clicked cell and reports its row and column
+// through a single signal, so cells don't need signals(and JavaScript listeners) of their own. Rows added later work without any setup.
+class TableClicks {
+   public:
+    // gets the cell at the moment of the click, so rows may be inserted and deleted in the meantime
+    using Handler = std::function<void(Wt::WTableCell* cell)>;
+
+    explicit TableClicks(Wt::WTable& table) : tableWidget(&table), cellClicked(&table, "cellClicked"), findCell(&table) {
+        findCell.setJavaScript(findCellJavaScript());
+        table.clicked().connect(findCell);
+        cellClicked.connect(std::bind([this](int row, int column) { dispatch(row, column); }, std::placeholders::_1, std::placeholders::_2));
+    }
+
+    // replaces previous handler of the column, nothing happens if column is -1(e.g. it's not in the TableSchema)
+    void onColumn(int column, Handler handler) {
+        if (column == -1)
+            return;
+
+        if (column >= static_cast<int>(handlers.size()))
+            handlers.resize(column + 1);
+
+        handlers[column] = std::move(handler);
+        findCell.setJavaScript(findCellJavaScript());
+    }
+
+    Wt::WTable& table() const {
+        return *tableWidget;
+    }
+
+   private:
+    // only clicks on body cells(header ones are th) of columns with a handler go to the server
+    std::string findCellJavaScript() const {
+        auto columns = std::string{};
+        for (auto i = 0u; i < handlers.size(); i++) {
+            if (handlers[i])
+                columns += (columns.empty() ? "" : ",") + std::to_string(i);
+        }
+
+        return "function(table, e) {"
+               "  var cell = e.target || e.srcElement;"
+               "  while (cell && cell !== table && !(cell.tagName === 'TD' && cell.parentNode.parentNode.parentNode === table))"
+               "    cell = cell.parentNode;"
+               "  if (!cell || cell === table || [" + columns + "].indexOf(cell.cellIndex) === -1)"
+               "    return;"
+               "  " + cellClicked.createCall("cell.parentNode.rowIndex", "cell.cellIndex") + ";"
+               "}";
+    }
+
+    void dispatch(int row, int column) {
+        // coordinates come from the browser, so they may be stale or made up
+        if (row < tableWidget->headerCount() || row >= tableWidget->rowCount() || column < 0 || column >= tableWidget->columnCount())
+            return;
+
+        if (column < static_cast<int>(handlers.size()) && handlers[column])
+            handlers[column](tableWidget->elementAt(row, column));
+    }
+
+    Wt::WTable* tableWidget;
+    Wt::JSignal<int, int> cellClicked;
+    Wt::JSlot findCell;
+    std::vector<Handler> handlers;
+};
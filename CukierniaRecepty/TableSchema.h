@@ -0,0 +1,80 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include <Wt/WString>
+#include <Wt/WTable>
+#include <Wt/WText>
+
+// Columns of a WTable, identified by keys(e.g. enum of the widget). Keys are mapped to column indices once,
+// when the schema is created, so cells are addressed directly instead of looking up header texts.
+class TableSchema {
+   public:
+    struct Column {
+        int key;
+        std::wstring header;
+    };
+
+    TableSchema() = default;
+
+    explicit TableSchema(std::vector<Column> columns) : columns(std::move(columns)) {
+        for (auto i = 0u; i < this->columns.size(); i++) {
+            auto key = this->columns[i].key;
+            if (key >= static_cast<int>(keyToColumn.size()))
+                keyToColumn.resize(key + 1, -1);
+
+            keyToColumn[key] = static_cast<int>(i);
+        }
+    }
+
+    // -1 if the table doesn't have such column(e.g. it's hidden from the user)
+    int column(int key) const {
+        return key >= 0 && key < static_cast<int>(keyToColumn.size()) ? keyToColumn[key] : -1;
+    }
+
+    int size() const {
+        return static_cast<int>(columns.size());
+    }
+
+    void buildHeader(Wt::WTable& table) const {
+        table.setHeaderCount(1);
+        for (auto i = 0; i < size(); i++) {
+            table.elementAt(0, i)->clear();
+            table.elementAt(0, i)->addWidget(new Wt::WText(columns[i].header));
+        }
+    }
+
+   private:
+    std::vector<Column> columns;
+    std::vector<int> keyToColumn;
+};
+
+// Content of one table row, filled by key. Meant to be reused for all rows of a table.
+class TableRow {
+   public:
+    explicit TableRow(const TableSchema& schema) : schema(&schema), cells(schema.size()) {}
+
+    // ignored if the column isn't in the schema
+    void set(int key, Wt::WString value) {
+        auto column = schema->column(key);
+        if (column != -1)
+            cells[column] = std::move(value);
+    }
+
+    const Wt::WString& cell(int column) const {
+        return cells[column];
+    }
+
+    int size() const {
+        return static_cast<int>(cells.size());
+    }
+
+    void clear() {
+        for (auto& cell : cells)
+            cell = Wt::WString::Empty;
+    }
+
+   private:
+    const TableSchema* schema;
+    std::vector<Wt::WString> cells;
+};
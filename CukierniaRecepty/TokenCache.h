@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <boost/optional.hpp>
+#include "CurrentUser.h"
+#include "Metrics.h"
+
+// Server-wide cache of validated auth tokens(the "logincookie"), so that a new tab of a logged in user resumes without looking up
+// the token, the user and its firm in the database. Keys are token hashes(same as in auth_token), never the tokens themselves.
+// Entries live for a TTL, so a change of the user(e.g. disabled, moved to another firm) is seen at the latest after it.
+class TokenCache {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::string userID;
+        CurrentUser user;
+        Clock::time_point expires;
+    };
+
+    static TokenCache& instance() {
+        static TokenCache cache;
+        return cache;
+    }
+
+    // ttl 0 turns the cache off
+    void configure(std::chrono::seconds ttl, std::size_t capacity) {
+        std::lock_guard<std::mutex> lock{mutex};
+        this->ttl = ttl;
+        this->capacity = capacity;
+        entries.clear();
+
+        auto& metrics = Metrics::instance();
+        metrics.gauge("bakery_auth_token_cache_entries", "Auth tokens in the resume cache.", [this] {
+            std::lock_guard<std::mutex> lock{mutex};
+            return static_cast<double>(entries.size());
+        });
+        metrics.counter("bakery_auth_token_cache_hits_total", "Sessions resumed from the cache.", [this] { return static_cast<double>(hits); });
+        metrics.counter("bakery_auth_token_cache_misses_total", "Sessions resumed through the database.", [this] { return static_cast<double>(misses); });
+    }
+
+    boost::optional<Entry> find(const std::string& tokenHash) {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto entry = entries.find(tokenHash);
+        if (entry == entries.end() || entry->second.expires <= Clock::now()) {
+            if (entry != entries.end())
+                entries.erase(entry);
+            misses++;
+            return boost::none;
+        }
+
+        hits++;
+        return entry->second;
+    }
+
+    void put(const std::string& tokenHash, const std::string& userID, const CurrentUser& user) {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (ttl.count() == 0 || capacity == 0)
+            return;
+
+        auto now = Clock::now();
+        if (entries.size() >= capacity)
+            evict(now);
+
+        entries[tokenHash] = Entry{userID, user, now + ttl};
+    }
+
+    // e.g. token was used up by rotation or removed at logout
+    void remove(const std::string& tokenHash) {
+        std::lock_guard<std::mutex> lock{mutex};
+        entries.erase(tokenHash);
+    }
+
+   private:
+    TokenCache() = default;
+
+    // expired entries, and if there are none the one expiring first
+    void evict(Clock::time_point now) {
+        auto first = entries.end();
+        for (auto entry = entries.begin(); entry != entries.end();) {
+            if (entry->second.expires <= now) {
+                entry = entries.erase(entry);
+                continue;
+            }
+
+            if (first == entries.end() || entry->second.expires < first->second.expires)
+                first = entry;
+            ++entry;
+        }
+
+        if (entries.size() >= capacity && first != entries.end())
+            entries.erase(first);
+    }
+
+    std::mutex mutex;
+    std::chrono::seconds ttl{0};
+    std::size_t capacity = 0;
+    std::unordered_map<std::string, Entry> entries;
+    std::atomic<unsigned long long> hits{0};
+    std::atomic<unsigned long long> misses{0};
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include <string>
+#include <Wt/WServer>
+#include <Wt/WLogger>
+#include <Wt/WResource>
+#include <Wt/Http/Request>
+#include <Wt/Http/Response>
+#include "Tracing.h"
+
+// Tracing settings, read from <properties> of wt_config.xml.
+struct TracingConfig {
+    double sampleRate = 0.01;  // fraction of requests which are traced
+    int bufferEvents = 4096;  // latest events kept by every thread
+    std::string token;  // has to be given as ?token= to download the trace, TraceResource isn't deployed without it
+
+    static TracingConfig fromServer(const Wt::WServer& server) {
+        auto config = TracingConfig{};
+        auto text = std::string{};
+        try {
+            if (server.readConfigurationProperty("trace-sample-rate", text))
+                config.sampleRate = std::stod(text);
+            if (server.readConfigurationProperty("trace-buffer-events", text))
+                config.bufferEvents = std::stoi(text);
+        } catch (const std::exception&) {
+            Wt::log("error") << "TracingConfig: property is not a number(\"" << text << "\"), using defaults for the rest";
+        }
+        server.readConfigurationProperty("trace-token", config.token);
+
+        return config;
+    }
+};
+
+// Latest spans of all threads as Chrome trace events, deployed by main() at /admin/trace. Open the downloaded file in chrome://tracing or Perfetto.
+class TraceResource : public Wt::WResource {
+   public:
+    explicit TraceResource(std::string token) : token(std::move(token)) {
+        suggestFileName("trace.json");
+    }
+
+    ~TraceResource() override {
+        beingDeleted();
+    }
+
+    void handleRequest(const Wt::Http::Request& request, Wt::Http::Response& response) override {
+        auto given = request.getParameter("token");
+        if (token.empty() || !given || *given != token) {
+            response.setStatus(403);
+            return;
+        }
+
+        response.setMimeType("application/json");
+        response.out() << Tracing::instance().chromeTrace();
+    }
+
+   private:
+    const std::string token;
+};
@@ -0,0 +1,192 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+
+// Spans of work done while handling a request(e.g. populate* of widgets, Dbo statements), exported by TraceResource as Chrome trace events.
+// Only sampled requests are traced, a span outside of them costs one check of a thread-local flag, so it can stay on in production.
+// Every thread writes into its own ring buffer of the latest events, older ones are overwritten.
+class Tracing {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    // measures from construction to destruction, e.g. Tracing::Span span{"RecipesWidget::populateRecipeList"}; name has to be a literal
+    class Span {
+       public:
+        explicit Span(const char* name) : name(sampling() ? name : nullptr) {
+            if (this->name)
+                start = Clock::now();
+        }
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+        ~Span() {
+            if (name)
+                record(name, start, Clock::now());
+        }
+
+       private:
+        const char* name;  // nullptr if the request isn't sampled
+        Clock::time_point start;
+    };
+
+    // every request handled by App is one, it decides whether the request is sampled
+    class RequestScope {
+       public:
+        RequestScope() : previous(current()) {
+            auto& tracing = instance();
+            auto rate = tracing.sampleRate.load(std::memory_order_relaxed);
+            if (rate > 0 && std::uniform_real_distribution<double>(0, 1)(random()) < rate)
+                current() = ++tracing.lastRequest;
+            else
+                current() = 0;
+        }
+
+        RequestScope(const RequestScope&) = delete;
+        RequestScope& operator=(const RequestScope&) = delete;
+
+        ~RequestScope() {
+            current() = previous;
+        }
+
+       private:
+        static std::minstd_rand& random() {
+            static thread_local std::minstd_rand generator{std::random_device{}()};
+            return generator;
+        }
+
+        unsigned long long previous;
+    };
+
+    static Tracing& instance() {
+        static Tracing tracing;
+        return tracing;
+    }
+
+    // rate is a fraction of requests(0 turns tracing off, 1 traces all), events is the size of the ring buffer of each thread
+    void configure(double rate, int events) {
+        sampleRate = std::min(std::max(rate, 0.0), 1.0);
+        bufferEvents = static_cast<std::size_t>(std::max(events, 1));
+    }
+
+    static bool sampling() {
+        return current() != 0;
+    }
+
+    // for spans which don't fit a scope, e.g. transactions started and committed in different calls
+    static void record(std::string name, Clock::time_point start, Clock::time_point end) {
+        if (!sampling())
+            return;
+
+        auto& buffer = threadBuffer();
+        std::lock_guard<std::mutex> lock{buffer.mutex};
+        auto event = Event{std::move(name), start, end - start, current()};
+        if (buffer.events.size() < buffer.capacity) {
+            buffer.events.push_back(std::move(event));
+        } else {
+            buffer.events[buffer.next] = std::move(event);
+            buffer.next = (buffer.next + 1) % buffer.capacity;
+        }
+    }
+
+    // events of all threads, in the Trace Event Format read by chrome://tracing and Perfetto
+    std::string chromeTrace() const {
+        auto buffers = std::vector<std::shared_ptr<Buffer>>{};
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            buffers = threads;
+        }
+
+        auto out = std::ostringstream{};
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        auto first = true;
+        for (const auto& buffer : buffers) {
+            std::lock_guard<std::mutex> lock{buffer->mutex};
+            for (const auto& event : buffer->events) {
+                out << (first ? "" : ",") << "\n{\"name\":\"" << escape(event.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread
+                    << ",\"ts\":" << microseconds(event.start - epoch) << ",\"dur\":" << microseconds(event.duration)
+                    << ",\"args\":{\"request\":" << event.request << "}}";
+                first = false;
+            }
+        }
+        out << "\n]}\n";
+
+        return out.str();
+    }
+
+   private:
+    struct Event {
+        std::string name;
+        Clock::time_point start;
+        Clock::duration duration;
+        unsigned long long request;
+    };
+
+    struct Buffer {
+        std::mutex mutex;  // taken by the exporter, otherwise only by the owning thread
+        int thread;
+        std::size_t capacity;
+        std::size_t next = 0;  // oldest event once the buffer is full
+        std::vector<Event> events;
+    };
+
+    Tracing() = default;
+
+    // sampled request of the thread, 0 if it isn't
+    static unsigned long long& current() {
+        static thread_local unsigned long long request = 0;
+        return request;
+    }
+
+    // created on the first sampled span of the thread, kept by the registry so that events outlive the thread
+    static Buffer& threadBuffer() {
+        static thread_local std::shared_ptr<Buffer> buffer;
+        if (!buffer) {
+            auto& tracing = instance();
+            buffer = std::make_shared<Buffer>();
+            buffer->capacity = tracing.bufferEvents;
+
+            std::lock_guard<std::mutex> lock{tracing.mutex};
+            buffer->thread = static_cast<int>(tracing.threads.size()) + 1;
+            tracing.threads.push_back(buffer);
+        }
+
+        return *buffer;
+    }
+
+    static std::string microseconds(Clock::duration duration) {
+        auto out = std::ostringstream{};
+        out << std::fixed << std::setprecision(3) << std::chrono::duration<double, std::micro>(duration).count();
+        return out.str();
+    }
+
+    static std::string escape(const std::string& value) {
+        auto escaped = std::string{};
+        for (auto c : value) {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            if (static_cast<unsigned char>(c) < 0x20)
+                escaped += ' ';
+            else
+                escaped += c;
+        }
+
+        return escaped;
+    }
+
+    const Clock::time_point epoch = Clock::now();
+    std::atomic<double> sampleRate{0};
+    std::atomic<std::size_t> bufferEvents{4096};
+    std::atomic<unsigned long long> lastRequest{0};
+
+    mutable std::mutex mutex;
+    std::vector<std::shared_ptr<Buffer>> threads;
+};
@@ -1,6 +1,8 @@
 #pragma once
 #include <Wt/Dbo/Dbo>
 #include "database.h"
+#include "UnitConversions.h"
+#include "SchemaIndex.h"
 
 class Unit {
    public:
@@ -17,58 +19,17 @@ class Unit {
         Wt::Dbo::field(action, ownerID, "owner_id");
     }
 
-    // returns all the parent units, self included, to the root unit. Root unit is last in the vector.
-    static std::vector<Wt::Dbo::ptr<Unit>> pathToTheRoot(Database& db, Wt::Dbo::dbo_traits<Unit>::IdType unit) {
-        auto results = std::vector<Wt::Dbo::ptr<Unit>>{};
-
-        auto currentID = unit;
-        while (currentID != Wt::Dbo::dbo_traits<Unit>::invalidId()) {
-            Wt::Dbo::ptr<Unit> currentUnit = db.find<Unit>().where("id = ?").bind(currentID);
-            if (currentUnit.id() == Wt::Dbo::dbo_traits<Unit>::invalidId()) {
-                return results;
-            }
-            results.push_back(currentUnit);
-            currentID = currentUnit->baseUnitID;
-        }
-
-        return results;
+    static std::vector<SchemaIndex> indexes() {
+        return {{"unit_owner_name", {"owner_id", "name(64)"}}, {"unit_base_unit", {"base_unit_id"}}};
     }
 
     // It will treat self as a parent of itself
-    static bool isDescended(Database& db, Wt::Dbo::dbo_traits<Unit>::IdType potentialChildID, Wt::Dbo::dbo_traits<Unit>::IdType potentialParentID) {
-        if (potentialParentID == Wt::Dbo::dbo_traits<Unit>::invalidId() || potentialChildID == Wt::Dbo::dbo_traits<Unit>::invalidId()) {
-            return false;
-        }
-
-        if (potentialChildID == potentialParentID) {
-            return true;
-        }
-
-        Wt::Dbo::ptr<Unit> potentialChild = db.find<Unit>().where("id = ?").bind(potentialChildID);
-        return isDescended(db, potentialChild->baseUnitID, potentialParentID);
+    static bool isDescended(const UnitConversions& conversions, Wt::Dbo::dbo_traits<Unit>::IdType potentialChildID,
+                            Wt::Dbo::dbo_traits<Unit>::IdType potentialParentID) {
+        return conversions.isDescended(potentialChildID, potentialParentID);
     }
 
-    static bool sameBranch(Database& db, Wt::Dbo::dbo_traits<Unit>::IdType unit1, Wt::Dbo::dbo_traits<Unit>::IdType unit2) {
-        auto transaction = Wt::Dbo::Transaction(db);
-        auto baseUnit1 = unit1;
-        auto baseUnit2 = unit2;
-
-        auto currentID = unit1;
-        while (currentID != Wt::Dbo::dbo_traits<Unit>::invalidId()) {
-            baseUnit1 = currentID;
-
-            Wt::Dbo::ptr<Unit> currentUnit = db.find<Unit>().where("id = ?").bind(currentID);
-            currentID = currentUnit->baseUnitID;
-        }
-
-        currentID = unit2;
-        while (currentID != Wt::Dbo::dbo_traits<Unit>::invalidId()) {
-            baseUnit2 = currentID;
-
-            Wt::Dbo::ptr<Unit> currentUnit = db.find<Unit>().where("id = ?").bind(currentID);
-            currentID = currentUnit->baseUnitID;
-        }
-
-        return baseUnit1 == baseUnit2;
+    static bool sameBranch(const UnitConversions& conversions, Wt::Dbo::dbo_traits<Unit>::IdType unit1, Wt::Dbo::dbo_traits<Unit>::IdType unit2) {
+        return conversions.sameBranch(unit1, unit2);
     }
 };
@@ -0,0 +1,128 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include <Wt/Dbo/Dbo>
+#include "Tracing.h"
+
+// Unit tree of a single firm, flattened so that converting between units doesn't need any SQL.
+// Every unit knows its factor to the root unit(product of quantities on the path, self and root included), the root itself
+// and its position in a depth first walk of the tree. Units which are part of a cycle(or hang below one) are left out.
+class UnitConversions {
+   public:
+    using UnitID = Wt::Dbo::dbo_default_traits::IdType;
+
+    struct UnitRow {
+        UnitID id;
+        UnitID baseUnitID;
+        double quantity;
+    };
+
+    UnitConversions() = default;
+
+    explicit UnitConversions(const std::vector<UnitRow>& units) {
+        Tracing::Span span{"UnitConversions::build"};
+        auto quantities = std::unordered_map<UnitID, double>{};
+        for (const auto& unit : units) {
+            quantities[unit.id] = unit.quantity;
+        }
+
+        // units without a base unit, or whose base unit doesn't exist(e.g. it was deleted), are roots
+        auto children = std::unordered_map<UnitID, std::vector<UnitID>>{};
+        auto roots = std::vector<UnitID>{};
+        for (const auto& unit : units) {
+            if (quantities.count(unit.baseUnitID) == 0) {
+                roots.push_back(unit.id);
+            } else {
+                children[unit.baseUnitID].push_back(unit.id);
+            }
+        }
+
+        auto counter = 0;
+        for (auto root : roots) {
+            entries[root].factor = quantities[root];
+
+            // second member tells whether all children of the unit were already visited
+            auto stack = std::vector<std::pair<UnitID, bool>>{{root, false}};
+            while (!stack.empty()) {
+                auto current = stack.back();
+                stack.pop_back();
+
+                auto& entry = entries[current.first];
+                if (current.second) {
+                    entry.leave = counter++;
+                    continue;
+                }
+
+                entry.root = root;
+                entry.enter = counter++;
+                stack.emplace_back(current.first, true);
+
+                auto currentChildren = children.find(current.first);
+                if (currentChildren == children.end()) {
+                    continue;
+                }
+
+                auto factor = entry.factor;
+                for (auto child : currentChildren->second) {
+                    entries[child].factor = factor * quantities[child];
+                    stack.emplace_back(child, false);
+                }
+            }
+        }
+    }
+
+    bool contains(UnitID unit) const {
+        return entries.count(unit) != 0;
+    }
+
+    // 1.0 for unknown units(deleted, or in a cycle), so that they don't affect the conversion
+    double factor(UnitID unit) const {
+        auto entry = entries.find(unit);
+        return entry != entries.end() ? entry->second.factor : 1.0;
+    }
+
+    // invalid id for unknown units
+    UnitID root(UnitID unit) const {
+        auto entry = entries.find(unit);
+        return entry != entries.end() ? entry->second.root : Wt::Dbo::dbo_default_traits::invalidId();
+    }
+
+    bool sameBranch(UnitID unit1, UnitID unit2) const {
+        return contains(unit1) && contains(unit2) && root(unit1) == root(unit2);
+    }
+
+    // It will treat self as a parent of itself
+    bool isDescended(UnitID potentialChild, UnitID potentialParent) const {
+        auto child = entries.find(potentialChild);
+        auto parent = entries.find(potentialParent);
+        if (child == entries.end() || parent == entries.end()) {
+            return false;
+        }
+
+        return parent->second.enter <= child->second.enter && child->second.leave <= parent->second.leave;
+    }
+
+    // unit itself and all units below it, empty for unknown units
+    std::vector<UnitID> subtree(UnitID unit) const {
+        Tracing::Span span{"UnitConversions::subtree"};
+        auto results = std::vector<UnitID>{};
+        for (const auto& entry : entries) {
+            if (isDescended(entry.first, unit)) {
+                results.push_back(entry.first);
+            }
+        }
+
+        return results;
+    }
+
+   private:
+    struct Entry {
+        UnitID root = Wt::Dbo::dbo_default_traits::invalidId();
+        double factor = 1.0;
+        int enter = 0;
+        int leave = 0;
+    };
+
+    std::unordered_map<UnitID, Entry> entries;
+};
@@ -1,6 +1,5 @@
 #pragma once
 #include <memory>
-#include <unordered_map>
 #include <Wt/Dbo/Session>
 #include <Wt/WContainerWidget>
 #include <Wt/WText>
@@ -8,10 +7,19 @@
 #include <Wt/WDialog>
 #include <Wt/WPushButton>
 #include <Wt/WDoubleValidator>
+#include <Wt/WTableView>
+#include <boost/tuple/tuple.hpp>
 #include "Unit.h"
+#include "Tracing.h"
 #include "Recipe.h"
 #include "Ingredient.h"
 #include "helpers.h"
+#include "QueryTableModel.h"
+#include "ComboBoxDelegate.h"
+#include "References.h"
+#include "FirmCatalog.h"
+#include "FirmChanges.h"
+#include "RecipeTotals.h"
 
 class UnitsWidget : public Wt::WContainerWidget {
     const std::wstring colName = L"Nazwa";
@@ -20,31 +28,37 @@ class UnitsWidget : public Wt::WContainerWidget {
     const std::wstring colDelete = L"Usuń";
    public:
     UnitsWidget(Wt::WContainerWidget*, Database& db) : db(&db) {
-        if(db.users->find(db.login.user())->user()->accessLevel != 0) {
+        if(db.currentUser().canEdit()) {
             addButton = std::make_unique<Wt::WPushButton>(L"Dodaj jednostkę", this);
             addButton->clicked().connect(this, &UnitsWidget::showAddDialog);
         }
 
-        unitList = std::make_unique<Wt::WTable>(this);
-        unitList->addStyleClass("table table-stripped table-bordered");
+        unitList = std::make_unique<Wt::WTableView>(this);
+        unitList->setAlternatingRowColors(true);
+        unitList->setHeight(600);
+        unitList->setEditTriggers(Wt::WAbstractItemView::SingleClicked);
+        unitList->clicked().connect(std::bind([this](const Wt::WModelIndex& index) { cellClicked(index); }, std::placeholders::_1));
 
-        populateUnitsList();
+        createModel(db.currentUser().canEdit());
+        changes = FirmChanges::instance().subscribe(db.currentUser().firmID, [this](const FirmChanges::Change& change) { applyChange(change); });
     }
 
     void populateUnitsList() {
-        populateUnitsTable();
-
-        if(db->users->find(db->login.user())->user()->accessLevel != 0) {
-            makeTableEditable();
-            setupDeleteAction();
-        }
+        Tracing::Span span{"UnitsWidget::populateUnitsList"};
+        model->reload();
     }
 
    private:
+    // unit with name of its base unit(empty if there's none)
+    using UnitRow = boost::tuple<Wt::Dbo::ptr<Unit>, Wt::WString>;
+    using Column = QueryTableModel<UnitRow>::Column;
+
     Database* db;
-    std::unique_ptr<Wt::WTable> unitList;
-    std::unordered_map<int, Wt::Dbo::dbo_traits<Unit>::IdType> rowToID;
+    std::unique_ptr<QueryTableModel<UnitRow>> model;
+    std::unique_ptr<ComboBoxDelegate> baseUnitDelegate;
+    std::unique_ptr<Wt::WTableView> unitList;
     std::unique_ptr<Wt::WPushButton> addButton;
+    FirmChanges::Subscription changes;
 
     void showAddDialog() {
         Wt::WDialog* dialog = new Wt::WDialog(L"Dodaj jednostkę");
@@ -52,8 +66,7 @@ class UnitsWidget : public Wt::WContainerWidget {
         auto quantityField = createLabeledField<Wt::WLineEdit>(L"Ilość", dialog->contents());
 
         auto baseUnitField = createLabeledField<Wt::WComboBox>("Jednostka bazowa", dialog->contents());
-        auto baseUnitIDs = populateComboBox<Unit>(*db, *baseUnitField, [](const Unit& elem) { return elem.name; },
-            [this](const Wt::Dbo::ptr<Unit>& elem) { return elem->ownerID == db->users->find(db->login.user())->user()->firmID; });
+        auto baseUnitIDs = populateComboBox(*baseUnitField, FirmCatalog::instance().snapshot(*db, db->currentUser().firmID)->units);
         baseUnitField->insertItem(0, "Brak");
         baseUnitIDs.insert(baseUnitIDs.begin(), Wt::Dbo::dbo_traits<Unit>::invalidId());
 
@@ -99,199 +112,215 @@ class UnitsWidget : public Wt::WContainerWidget {
         auto unit = new Unit;  // seems that it's necessary
         unit->name = name;
         unit->quantity = std::stod(quantity);
-        unit->ownerID = db->users->find(db->login.user())->user()->firmID;
+        unit->ownerID = db->currentUser().firmID;
 
         Wt::Dbo::Transaction transaction(*db);
         Wt::Dbo::ptr<Unit> baseUnit = db->find<Unit>().where("id = ?").bind(baseUnitID);
         unit->baseUnitID = baseUnit.id();
 
-        db->add<Unit>(unit);
+        auto added = db->add<Unit>(unit);
+        db->flush();
+        transaction.commit();
+
+        FirmCatalog::instance().putUnit(added->ownerID, added.id(), *added);
+        publish(FirmChanges::Kind::Added, added.id());
     }
 
-    void populateUnitsTable() {
-        rowToID.clear();
-        populateTable<Unit>(*db, *unitList, [&](const Wt::Dbo::ptr<Unit>& unit, int row) {
-            auto transaction = Wt::Dbo::Transaction{*db};
-            rowToID.insert(std::make_pair(row, unit.id()));
+    void createModel(bool editable) {
+        std::vector<Column> columns;
 
-            Wt::Dbo::ptr<Unit> baseUnit = db->find<Unit>().where("id = ?").bind(unit->baseUnitID);
-            auto baseUnitName = baseUnit.id() != Wt::Dbo::dbo_traits<Unit>::invalidId() ? baseUnit->name : L"Brak";
+        auto nameColumn = Column{colName, [](const UnitRow& row) { return row.get<0>()->name; }, "u.name"};
+        if (editable)
+            nameColumn.edit = [this](const UnitRow& row, const boost::any& value) {
+                auto name = Wt::asString(value);
+                if (Wt::WValidator(true).validate(name).state() != Wt::WValidator::Valid) {
+                    return false;
+                }
 
-            std::vector<std::pair<std::wstring, Wt::WString>> columns;
-            columns.emplace_back(colName, unit->name);
-            columns.emplace_back(colBaseUnit, baseUnitName);
-            columns.emplace_back(colQuantity, std::to_string(unit->quantity));
+                auto unit = row.get<0>();
+                changeUnit(unit, [&name](Unit& changed) { changed.name = name; });
+
+                // units based on this one show its name too
+                model->refreshRows([&unit](const UnitRow& other) { return other.get<0>()->baseUnitID == unit.id(); });
+                return true;
+            };
+        columns.push_back(nameColumn);
+
+        auto baseUnitColumn = Column{colBaseUnit, [](const UnitRow& row) {
+                                         return row.get<1>().empty() ? Wt::WString("Brak") : row.get<1>();
+                                     }, "b.name"};
+        if (editable)
+            baseUnitColumn.edit = [this](const UnitRow& row, const boost::any& value) {
+                auto baseUnitID = boost::any_cast<ComboBoxDelegate::IdType>(value);
+                changeUnit(row.get<0>(), [baseUnitID](Unit& unit) { unit.baseUnitID = baseUnitID; });
+                return true;
+            };
+        columns.push_back(baseUnitColumn);
+
+        auto quantityColumn = Column{colQuantity, [](const UnitRow& row) { return Wt::WString(std::to_string(row.get<0>()->quantity)); }, "u.quantity"};
+        if (editable)
+            quantityColumn.edit = [this](const UnitRow& row, const boost::any& value) {
+                auto quantity = Wt::asString(value);
+                Wt::WDoubleValidator validator;
+                validator.setMandatory(true);
+                if (validator.validate(quantity).state() != Wt::WValidator::Valid) {
+                    return false;
+                }
 
-            if(db->users->find(db->login.user())->user()->accessLevel != 0)
-                columns.emplace_back(colDelete, "X");
+                auto number = std::stod(quantity.toUTF8());
+                changeUnit(row.get<0>(), [number](Unit& unit) { unit.quantity = number; });
+                return true;
+            };
+        columns.push_back(quantityColumn);
+
+        if (editable)
+            columns.push_back({colDelete, [](const UnitRow&) { return Wt::WString("X"); }, ""});
+
+        model = std::make_unique<QueryTableModel<UnitRow>>(
+            std::move(columns),
+            [this] {
+                auto transaction = Wt::Dbo::Transaction{*db};
+                int units = db->query<int>("select count(1) from unit").where("owner_id = ?").bind(db->currentUser().firmID);
+                return units;
+            },
+            [this](int offset, int limit, const std::string& orderBy) {
+                Tracing::Span span{"UnitsWidget::fetchUnits"};
+                auto transaction = Wt::Dbo::Transaction{*db};
+                Wt::Dbo::collection<UnitRow> rows = rowQuery().orderBy(orderBy + ", u.id").limit(limit).offset(offset);
+                return std::vector<UnitRow>(rows.begin(), rows.end());
+            },
+            [this](Wt::Dbo::dbo_traits<Unit>::IdType id) -> boost::optional<UnitRow> {
+                auto transaction = Wt::Dbo::Transaction{*db};
+                Wt::Dbo::collection<UnitRow> rows = rowQuery().where("u.id = ?").bind(id);
+                for (const auto& row : rows)
+                    return boost::make_optional(row);
+                return boost::optional<UnitRow>();
+            },
+            [](const UnitRow& row) { return row.get<0>().id(); },
+            "u.name");
+
+        unitList->setModel(model.get());
+        if (model->columnOf(colDelete) != -1)
+            unitList->setSortingEnabled(model->columnOf(colDelete), false);
+
+        // unit can be based only on a unit from its own branch(or on nothing)
+        baseUnitDelegate = std::make_unique<ComboBoxDelegate>([this](const Wt::WModelIndex& index) {
+            auto catalog = FirmCatalog::instance().snapshot(*db, db->currentUser().firmID);
+            auto unitID = model->idAt(index.row());
+
+            auto options = ComboBoxDelegate::Options{{Wt::Dbo::dbo_traits<Unit>::invalidId(), "Brak"}};
+            for (const auto& unit : catalog->units) {
+                if (unit.first != unitID && Unit::sameBranch(catalog->conversions, unit.first, unitID))
+                    options.emplace_back(unit.first, unit.second.name);
+            }
 
-            return columns;
-        },
-        [this](const Wt::Dbo::ptr<Unit>& unit) {
-            Wt::Dbo::Transaction t{*db};
-            return unit->ownerID == db->users->find(db->login.user())->user()->firmID;
+            return options;
         });
+        unitList->setItemDelegateForColumn(model->columnOf(colBaseUnit), baseUnitDelegate.get());
     }
 
-    void makeTableEditable() {
-        // setup editing name of unit
-        makeTextCellsInteractive(*unitList, colName, [&](int row, const Wt::WLineEdit& field, Wt::WString oldContent) {
-            if (Wt::WValidator(true).validate(field.text()).state() != Wt::WValidator::Valid) {
-                return oldContent;
-            }
+    // commits the change right away, so that other sessions can see it in the catalog(and convert with new quantities)
+    void changeUnit(Wt::Dbo::ptr<Unit> unit, std::function<void(Unit&)> change) {
+        auto before = FirmCatalog::instance().snapshot(*db, unit->ownerID);  // conversions from before the change, see RecipeTotals::unitChanged
 
-            Wt::Dbo::Transaction transcation{*db};
-            Wt::Dbo::ptr<Unit> unit = db->find<Unit>().where("id = ?").bind(rowToID[row]);
+        Wt::Dbo::Transaction transaction{*db};
+        auto oldName = unit->name;
+        change(*unit.modify());
+        if (unit->name == oldName)
+            RecipeTotals::unitChanged(*db, unit->ownerID, unit.id(), before->conversions);
 
-            updateUnits(field.text(), unit->name);
-            unit.modify()->name = field.text();
+        transaction.commit();
 
-            return Wt::WString(unit->name);
-        });
+        FirmCatalog::instance().putUnit(unit->ownerID, unit.id(), *unit);
+        publish(FirmChanges::Kind::Changed, unit.id());
+    }
 
-        // setup editing quantity of unit
-        makeTextCellsInteractive(*unitList, colQuantity, [&](int row, const Wt::WLineEdit& field, Wt::WString oldContent) {
-            Wt::WDoubleValidator validator;
-            validator.setMandatory(true);
-            if (validator.validate(field.text()).state() != Wt::WValidator::Valid) {
-                return oldContent.narrow();
-            }
+    void publish(FirmChanges::Kind kind, Wt::Dbo::dbo_traits<Unit>::IdType id) {
+        FirmChanges::instance().publish(db->currentUser().firmID, {FirmChanges::Entity::Unit, kind, id}, changes);
+    }
 
-            Wt::Dbo::Transaction transcation{*db};
-            Wt::Dbo::ptr<Unit> unit = db->find<Unit>().where("id = ?").bind(rowToID[row]);
-            unit.modify()->quantity = std::stod(field.text());
-            return std::to_string(unit->quantity);
-        });
+    // change made by another widget(or session), only affected rows are read again
+    void applyChange(const FirmChanges::Change& change) {
+        if (change.entity != FirmChanges::Entity::Unit)
+            return;
 
-        // setup editing base unit of unit
-        auto unitKeys = std::make_shared<std::vector<Wt::Dbo::dbo_traits<Unit>::IdType>>();
-        makeCellsInteractive<Wt::WComboBox>(
-            *unitList, colBaseUnit,
-            [this, unitKeys](int row, Wt::WComboBox& editField) {
-                auto oldContent = (Wt::WText*)unitList->elementAt(row, findColumn(*unitList, colBaseUnit))->widget(0);
-                auto oldUnitName = oldContent->text();
+        if (change.kind == FirmChanges::Kind::Added) {
+            model->reload();
+        } else if (change.kind == FirmChanges::Kind::Removed) {
+            model->removeRecord(change.id);
+        } else {
+            reread<Unit>(*db, change.id);
+            model->refreshRows([&change](const UnitRow& row) { return row.get<0>().id() == change.id || row.get<0>()->baseUnitID == change.id; });
+        }
+    }
 
-                *unitKeys = populateComboBox<Unit>(*db, editField, [](const Unit& unit) { return unit.name; },
-                   [this, row](Wt::Dbo::ptr<Unit> potentialNewUnit) {
-                       return potentialNewUnit.id() != rowToID[row] && Unit::sameBranch(*db, potentialNewUnit.id(), rowToID[row]);
-                   });
+    Wt::Dbo::Query<UnitRow> rowQuery() {
+        return db->query<UnitRow>("select u, coalesce(b.name, '') from unit u left join unit b on b.id = u.base_unit_id")
+            .where("u.owner_id = ?").bind(db->currentUser().firmID);
+    }
 
-                unitKeys->insert(unitKeys->begin(), Wt::Dbo::dbo_traits<Unit>::invalidId());
+    void cellClicked(const Wt::WModelIndex& index) {
+        if (!index.isValid() || index.column() != model->columnOf(colDelete))
+            return;
 
-                editField.insertItem(0, "Brak");
-                auto indexOfOldUnit = editField.findText(oldUnitName);
-                editField.setCurrentIndex(indexOfOldUnit);
-            },
-            [this, unitKeys](int row, const Wt::WComboBox& filledEditField, Wt::WString oldContent) {
-                auto transaction = Wt::Dbo::Transaction(*db);
-                Wt::Dbo::ptr<Unit> currentUnit = db->find<Unit>().where("id = ?").bind(rowToID[row]);
-
-                if (filledEditField.currentIndex() < 0) {
-                    currentUnit.modify()->baseUnitID = Wt::Dbo::dbo_traits<Unit>::invalidId();
-                    return oldContent;
-                } else {
-                    currentUnit.modify()->baseUnitID = (*unitKeys)[filledEditField.currentIndex()];
-                    return Wt::WString(filledEditField.currentText());
-                }
-            });
+        auto id = model->idAt(index.row());
+        auto confirmationDialog = new Wt::WDialog(L"Potwierdzenie usunięcia jednostki");
+        auto yesButton = new Wt::WPushButton("Tak", confirmationDialog->footer());
+        auto noButton = new Wt::WPushButton("Nie", confirmationDialog->footer());
+        new Wt::WText(L"Czy napewno usunąć jednostkę?", confirmationDialog->contents());
+        yesButton->clicked().connect(confirmationDialog, &Wt::WDialog::accept);
+        noButton->clicked().connect(confirmationDialog, &Wt::WDialog::reject);
+        confirmationDialog->rejectWhenEscapePressed();
+
+        confirmationDialog->finished().connect(std::bind([this, confirmationDialog, id] {
+            if (confirmationDialog->result() == Wt::WDialog::Accepted)
+                deleteUnit(id);
+
+            delete confirmationDialog;
+        }));
+
+        confirmationDialog->show();
     }
 
-    void setupDeleteAction() {
-        auto column = findColumn(*unitList, colDelete);
-        if (column == -1)
+    void deleteUnit(Wt::Dbo::dbo_traits<Unit>::IdType id) {
+        Wt::Dbo::Transaction transaction(*db);
+
+        auto unit = (Wt::Dbo::ptr<Unit>)db->find<Unit>().where("id = ?").bind(id);
+        if (unit.id() == Wt::Dbo::dbo_traits<Unit>::invalidId()) {
+            showMessageDialog(L"Jednostka nie istnieje", L"Jednostka została w międzyczasie usunięta.");
             return;
+        }
 
-        for (auto row = unitList->headerCount(); row < unitList->rowCount(); row++) {
-            unitList->elementAt(row, column)->clicked().connect(std::bind([this, row] {
-                auto confirmationDialog = new Wt::WDialog(L"Potwierdzenie usunięcia jednostki");
-                auto yesButton = new Wt::WPushButton("Tak", confirmationDialog->footer());
-                auto noButton = new Wt::WPushButton("Nie", confirmationDialog->footer());
-                new Wt::WText(L"Czy napewno usunąć jednostkę?", confirmationDialog->contents());
-                yesButton->clicked().connect(confirmationDialog, &Wt::WDialog::accept);
-                noButton->clicked().connect(confirmationDialog, &Wt::WDialog::reject);
-                confirmationDialog->rejectWhenEscapePressed();
-
-                confirmationDialog->finished().connect(std::bind([this, confirmationDialog, row] {
-                    if (confirmationDialog->result() != Wt::WDialog::Accepted)
-                        return;
-
-                    Wt::Dbo::Transaction transaction(*db);
-
-                    auto unit = (Wt::Dbo::ptr<Unit>)db->find<Unit>().where("id = ?").bind(rowToID[row]);
-                    {  // units must  be out of scope later(some strange thing happens in WT)
-                        auto units = (Wt::Dbo::collection<Wt::Dbo::ptr<Unit>>)db->find<Unit>();
-                        for (const auto& potentialBaseUnit : units) {
-                            if (potentialBaseUnit->baseUnitID == unit.id()) {
-                                auto dialog = new Wt::WDialog(L"Jednostka jest używana");
-                                auto okButton = new Wt::WPushButton("OK", dialog->footer());
-                                okButton->clicked().connect(dialog, &Wt::WDialog::accept);
-
-                                auto message = Wt::WString(L"Jednoska jest używana jako jednoska bazowa dla ") + potentialBaseUnit->name;
-                                message += L", więc nie może zostać usunięta";
-                                new Wt::WText(std::move(message), dialog->contents());
-
-                                dialog->finished().connect(std::bind([dialog] { delete dialog; }));
-
-                                dialog->show();
-                                return;
-                            }
-                        }
-                    }
-
-                    auto recipes = (Wt::Dbo::collection<Wt::Dbo::ptr<Recipe>>)db->find<Recipe>();
-                    for (const auto& recipe : recipes) {
-                        for (const auto& ingredientRecord : recipe->ingredientRecords) {
-                            if (ingredientRecord->unitID == unit.id()) {
-                                auto dialog = new Wt::WDialog(L"Jednoskta jest używana");
-                                auto okButton = new Wt::WPushButton("OK", dialog->footer());
-                                okButton->clicked().connect(dialog, &Wt::WDialog::accept);
-
-                                auto message = Wt::WString(L"Jednostka jest używana co najmniej w przepisie ") + recipe->name;
-                                message += L", więc nie może zostać usunięta.";
-                                new Wt::WText(std::move(message), dialog->contents());
-
-                                dialog->finished().connect(std::bind([dialog] { delete dialog; }));
-
-                                dialog->show();
-                                return;
-                            }
-                        }
-                    }
-
-                    auto ingredients = (Wt::Dbo::collection<Wt::Dbo::ptr<Ingredient>>)db->find<Ingredient>();
-                    for (const auto& ingredient : ingredients) {
-                        if (ingredient->unitID == unit.id()) {
-                            auto dialog = new Wt::WDialog(L"Jednostka jest używana");
-                            auto okButton = new Wt::WPushButton("OK", dialog->footer());
-                            okButton->clicked().connect(dialog, &Wt::WDialog::accept);
-
-                            auto message = Wt::WString(L"Jednostka jest używana co najmniej w składniku ") + ingredient->name;
-                            message += L", więc nie może zostać usunięta.";
-                            new Wt::WText(std::move(message), dialog->contents());
-
-                            dialog->finished().connect(std::bind([dialog] { delete dialog; }));
-
-                            dialog->show();
-                            return;
-                        }
-                    }
-
-                    unit.remove();
-                    populateUnitsList();
-                    delete confirmationDialog;
-                }));
-
-                confirmationDialog->show();
-            }));
+        auto units = References::unitsBasedOn(*db, unit.id());
+        if (!units.empty()) {
+            auto message = Wt::WString(L"Jednoska jest używana jako jednoska bazowa dla ") + units.front();
+            message += L", więc nie może zostać usunięta";
+            showMessageDialog(L"Jednostka jest używana", message);
+            return;
         }
-    }
 
-    void updateUnits(const Wt::WString& newName, const Wt::WString& oldName) {
-        for (auto row = unitList->headerCount(); row < unitList->rowCount(); row++) {
-            auto currentName = (Wt::WText*)unitList->elementAt(row, 2)->widget(0);
-            if (currentName->text() == oldName) {
-                currentName->setText(newName);
-            }
+        auto recipes = References::recipesUsingUnit(*db, unit.id());
+        if (!recipes.empty()) {
+            auto message = Wt::WString(L"Jednostka jest używana co najmniej w przepisie ") + recipes.front();
+            message += L", więc nie może zostać usunięta.";
+            showMessageDialog(L"Jednoskta jest używana", message);
+            return;
         }
+
+        auto ingredients = References::ingredientsUsingUnit(*db, unit.id());
+        if (!ingredients.empty()) {
+            auto message = Wt::WString(L"Jednostka jest używana co najmniej w składniku ") + ingredients.front();
+            message += L", więc nie może zostać usunięta.";
+            showMessageDialog(L"Jednostka jest używana", message);
+            return;
+        }
+
+        auto firmID = unit->ownerID;
+        unit.remove();
+        transaction.commit();
+
+        FirmCatalog::instance().removeUnit(firmID, id);
+        publish(FirmChanges::Kind::Removed, id);
+        model->removeRecord(id);
     }
 };
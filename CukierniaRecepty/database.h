@@ -1,45 +1,122 @@
 #pragma once
-#include <vector>
+#include <string>
+#include <utility>
+#include <boost/optional.hpp>
 #include <Wt/Dbo/Session>
 #include <Wt/Dbo/ptr>
 #include <Wt/Auth/Login>
+#include <Wt/Auth/User>
 #include <Wt/Auth/Dbo/UserDatabase>
 #include <Wt/Auth/AuthService>
 #include <Wt/Auth/HashFunction>
 #include <Wt/Auth/PasswordService>
 #include <Wt/Auth/PasswordVerifier>
-#include <Wt/Dbo/backend/MySQL>
+#include <Wt/Auth/PasswordHash>
 #include "User.h"
+#include "CurrentUser.h"
+#include "ConnectionPool.h"
+#include "SqlDialect.h"
+#include "PasswordHashing.h"
+#include "TokenCache.h"
 
-using UserDatabase = Wt::Auth::Dbo::UserDatabase<AuthInfo>;
+// Knows the status of a user resumed from TokenCache, so that Login::login doesn't have to load it.
+// Only users with the Normal status are cached.
+class UserDatabase : public Wt::Auth::Dbo::UserDatabase<AuthInfo> {
+   public:
+    explicit UserDatabase(Wt::Dbo::Session& session) : Wt::Auth::Dbo::UserDatabase<AuthInfo>(session) {}
+
+    void setResumedUser(const std::string& userID) {
+        resumedUserID = userID;
+    }
+
+    Wt::Auth::User::Status status(const Wt::Auth::User& user) const override {
+        if (!resumedUserID.empty() && user.id() == resumedUserID)
+            return Wt::Auth::User::Normal;
+
+        return Wt::Auth::Dbo::UserDatabase<AuthInfo>::status(user);
+    }
+
+   private:
+    std::string resumedUserID;
+};
 
 namespace {
 Wt::Auth::AuthService authService;
 Wt::Auth::PasswordService passService(authService);
+int bcryptCost = 7;
 }
 
 class Database : public Wt::Dbo::Session {
    public:
-    Database() {
-        connection = std::make_unique<Wt::Dbo::backend::MySQL>("cukiernia", "root", "root", "localhost", 3306);
-        setConnection(*connection);
+    // connections are borrowed from the server-wide pool for the duration of each transaction
+    explicit Database(ConnectionPool& pool) : connections(&pool), sqlDialect(pool.dialect()) {
+        setConnectionPool(pool);
+    }
+
+    // e.g. for a session of a background job, which can't share this one
+    ConnectionPool& pool() const {
+        return *connections;
+    }
+
+    // backend of the pool, for raw SQL
+    const SqlDialect& dialect() const {
+        return sqlDialect;
     }
 
-    void ensureTablesExisting() {
-        try {
-            this->createTables();
-            Wt::log("notice") << "Created tables";
-        } catch (const Wt::Dbo::Exception& e) {
-            Wt::log("warning") << "Exception while creating db schema(most likely tables already exist), error code: \"" << e.code() << "\"";
+    const CurrentUser& currentUser() const {
+        return current;
+    }
+
+    // has to be called whenever the login changes(in or out), widgets read firm and access level only from currentUser()
+    void refreshCurrentUser() {
+        current = CurrentUser{};
+        if (!users || !login.loggedIn()) {
+            resumed = boost::none;
+            return;
+        }
+
+        if (resumed && resumed->first == login.user().id()) {
+            current = resumed->second;
+            return;
+        }
+
+        Wt::Dbo::Transaction transaction{*this};
+        auto user = users->find(login.user())->user();
+        if (user.id() == Wt::Dbo::dbo_traits<User>::invalidId()) {
+            return;
         }
+
+        current.loggedIn = true;
+        current.firmID = user->firmID;
+        current.accessLevel = user->accessLevel;
     }
 
-    static void configureAuth() {
+    // passwords are checked by PasswordHashing threads(see PasswordLoginWidget), not by the session
+    static void configureAuth(const AuthConfig& config) {
+        bcryptCost = config.bcryptCost;
         authService.setAuthTokensEnabled(true, "logincookie");
         Wt::Auth::PasswordVerifier* verifier = new Wt::Auth::PasswordVerifier();
-        verifier->addHashFunction(new Wt::Auth::BCryptHashFunction(7));
+        verifier->addHashFunction(new Wt::Auth::BCryptHashFunction(bcryptCost));
         passService.setVerifier(verifier);
         passService.setAttemptThrottlingEnabled(true);
+        PasswordHashing::instance().start(config);
+        TokenCache::instance().configure(std::chrono::seconds(std::max(config.resumeCacheSeconds, 0)), static_cast<std::size_t>(std::max(config.resumeCacheSize, 0)));
+    }
+
+    // user of a session resumed from TokenCache, refreshCurrentUser takes firm and access level from it instead of the database
+    void setResumedUser(const std::string& userID, const CurrentUser& user) {
+        resumed = std::make_pair(userID, user);
+        if (users)
+            users->setResumedUser(userID);
+    }
+
+    // hash made by another function or with another bcrypt cost than the configured one, e.g. "$2y$07$..." when cost is 10
+    static bool needsRehash(const Wt::Auth::PasswordHash& hash) {
+        if (passService.verifier()->needsUpdate(hash))
+            return true;
+
+        const auto& value = hash.value();
+        return hash.function() == "bcrypt" && value.size() > 6 && value.compare(4, 3, (bcryptCost < 10 ? "0" : "") + std::to_string(bcryptCost) + "$") != 0;
     }
 
     static const Wt::Auth::AuthService& auth() {
@@ -52,8 +129,12 @@ class Database : public Wt::Dbo::Session {
 
     std::unique_ptr<UserDatabase> users;
     Wt::Auth::Login login;
+    std::string authTokenHash;  // hash of the auth token the session was resumed with(SessionResume), empty if none
 
    private:
-    std::unique_ptr<Wt::Dbo::SqlConnection> connection;
+    ConnectionPool* connections;
+    SqlDialect sqlDialect;
+    CurrentUser current;
+    boost::optional<std::pair<std::string, CurrentUser>> resumed;
 };
 
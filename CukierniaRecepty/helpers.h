@@ -1,4 +1,7 @@
 #pragma once
+#include <map>
+#include <vector>
+#include <algorithm>
 #include <functional>
 #include <Wt/WContainerWidget>
 #include <Wt/WText>
@@ -6,88 +9,82 @@
 #include <Wt/WLabel>
 #include <Wt/WComboBox>
 #include <Wt/WLineEdit>
+#include <Wt/WDialog>
+#include <Wt/WPushButton>
 #include "database.h"
+#include "TableSchema.h"
+#include "TableClicks.h"
+#include "Tracing.h"
 
-// returns -1 in case there's no matching column
-int findColumn(Wt::WTable& table, const std::wstring& colName) {
-    auto column = -1;
-    for (auto j = 0; j < table.columnCount(); j++) {
-        auto elem = dynamic_cast<Wt::WText*>(table.elementAt(0, j)->widget(0));
-        if (!elem) {
-            Wt::log("error") << "populateTable(): Table header contains something other than Wt::WText";
-            continue;
-        }
-        if (elem->text() == colName) {
-            column = j;
-            break;
-        }
-    }
-
-    return column;
-}
-
+// Clicked cell of the column is replaced by an edit field, confirming it with enter puts the final content back as text.
+// Handlers get the row the cell is in at the moment of editing, so rows may be inserted and deleted afterwards, rows appended later are editable too.
+// Column is an index from TableSchema, nothing happens if it's -1.
 template <class T>
-void makeCellsInteractive(Wt::WTable& table, const std::wstring& colName, std::function<void(int row, T& editField)> fieldInitializer,
+void makeCellsInteractive(TableClicks& clicks, int column, std::function<void(int row, T& editField)> fieldInitializer,
                           std::function<Wt::WString(int row, const T& editField, Wt::WString oldContent)> editAction) {
-    auto column = findColumn(table, colName);
-    if (column == -1) {
-        column = table.columnCount();
-        table.setHeaderCount(1);
-        table.elementAt(0, column)->addWidget(new Wt::WText(colName));
-    }
-
-    for (auto row = table.headerCount(); row < table.rowCount(); row++) {
-        table.elementAt(row, column)->clicked().connect(std::bind([=, &table] {
-                auto elem = dynamic_cast<Wt::WText*>(table.elementAt(row, column)->widget(0));
-                if (!elem)
-                    return;
-
-                auto oldContent = elem->text();
-
-                // setup widget, which is editable representation of table cell
-                auto editField = new T;
-                fieldInitializer(row, *editField);
-
-                // put editable widget in place of static text that was content of table cell until now
-                table.elementAt(row, column)->removeWidget(elem);
-                table.elementAt(row, column)->insertWidget(0, editField);
-
-                // setup confirmation of entered data
-                editField->enterPressed().connect(std::bind([&table, row, column, editAction, oldContent] {
-                    // perform user-defined action on data entered by user to widget setuped here, retrieve string containing final content of this widget
-                    auto filledEditField = (T*)table.elementAt(row, column)->widget(0);
-                    auto finalText = editAction(row, *filledEditField, std::move(oldContent));
-
-                    // replace editable widget with static text widget containing final content(retreived from caller)
-                    table.elementAt(row, column)->removeWidget(filledEditField);
-                    table.elementAt(row, column)->insertWidget(0, new Wt::WText(finalText));
-                }));
-            }));
-    }
+    clicks.onColumn(column, [=](Wt::WTableCell* cell) {
+        auto elem = dynamic_cast<Wt::WText*>(cell->widget(0));
+        if (!elem)
+            return;  // already being edited
+
+        auto oldContent = elem->text();
+
+        // setup widget, which is editable representation of table cell
+        auto editField = new T;
+        fieldInitializer(cell->row(), *editField);
+
+        // put editable widget in place of static text that was content of table cell until now
+        cell->removeWidget(elem);
+        cell->insertWidget(0, editField);
+
+        // setup confirmation of entered data
+        editField->enterPressed().connect(std::bind([cell, editAction, oldContent] {
+            // perform user-defined action on data entered by user to widget setuped here, retrieve string containing final content of this widget
+            auto filledEditField = (T*)cell->widget(0);
+            auto finalText = editAction(cell->row(), *filledEditField, std::move(oldContent));
+
+            // replace editable widget with static text widget containing final content(retreived from caller)
+            cell->removeWidget(filledEditField);
+            cell->insertWidget(0, new Wt::WText(finalText));
+        }));
+    });
 }
 
 // edit action Returns: final content of the table cell
-void makeTextCellsInteractive(Wt::WTable& table, const std::wstring& colName,
+void makeTextCellsInteractive(TableClicks& clicks, int column,
                               std::function<Wt::WString(int row, const Wt::WLineEdit& editField, Wt::WString oldContent)> editAction) {
-    auto column = findColumn(table, colName);
-    if (column == -1) {
-        column = table.columnCount();
-    }
-
-    makeCellsInteractive<Wt::WLineEdit>(table, colName, [&table, column](int row, Wt::WLineEdit& editField) {
-        auto currentTextField = (Wt::WText*)table.elementAt(row, column)->widget(0);
+    makeCellsInteractive<Wt::WLineEdit>(clicks, column, [&clicks, column](int row, Wt::WLineEdit& editField) {
+        auto currentTextField = (Wt::WText*)clicks.table().elementAt(row, column)->widget(0);
         editField.setText(currentTextField->text());
     }, editAction);
 }
 
+// Drops the session's copy of a record changed by another session(e.g. reported by FirmChanges), so that the next query reads it again
+template <class T>
+void reread(Database& db, typename Wt::Dbo::dbo_traits<T>::IdType id) {
+    auto transaction = Wt::Dbo::Transaction{db};
+    Wt::Dbo::ptr<T> record = db.find<T>().where("id = ?").bind(id);
+    if (record.id() != Wt::Dbo::dbo_traits<T>::invalidId())
+        record.reread();
+}
+
+// Query for records of the firm, can be narrowed down further with where()/orderBy() before passing it to populate* helpers
+template <class T>
+Wt::Dbo::Query<Wt::Dbo::ptr<T>> ownedBy(Database& db, int firmID) {
+    return db.find<T>().where("owner_id = ?").bind(firmID);
+}
+
 // Returns primary keys of objects which are reffered by combo box, order by indices of combo box
+// Query selects records in the database, filter is an optional check of loaded records which can't be expressed in SQL
 template <class T>
-std::vector<typename Wt::Dbo::dbo_traits<T>::IdType> populateComboBox(Database& db, Wt::WComboBox& comboBox, std::function<Wt::WString(const T&)> fieldSelector,
+std::vector<typename Wt::Dbo::dbo_traits<T>::IdType> populateComboBox(Database& db, Wt::WComboBox& comboBox, Wt::Dbo::Query<Wt::Dbo::ptr<T>> query,
+                                                                      std::function<Wt::WString(const T&)> fieldSelector,
                                                                       std::function<bool(typename Wt::Dbo::ptr<T>)> filter = [](typename Wt::Dbo::ptr<T>) {
                                                                           return true;
                                                                       }) {
+    Tracing::Span span{"populateComboBox"};
     auto transaction = Wt::Dbo::Transaction{db};
-    auto records = Wt::Dbo::collection<Wt::Dbo::ptr<T>>{db.find<T>()};
+    auto records = Wt::Dbo::collection<Wt::Dbo::ptr<T>>{query};
     auto primaryKeys = std::vector<typename Wt::Dbo::dbo_traits<T>::IdType>{};
 
     for (auto& record : records) {
@@ -100,37 +97,77 @@ std::vector<typename Wt::Dbo::dbo_traits<T>::IdType> populateComboBox(Database&
     return primaryKeys;
 }
 
+// Same for records of a FirmCatalog snapshot(e.g. catalog.units), no query needed. Filter gets id and the record.
+template <class T, class IdType, class Filter>
+std::vector<IdType> populateComboBox(Wt::WComboBox& comboBox, const std::map<IdType, T>& records, Filter filter) {
+    Tracing::Span span{"populateComboBox"};
+    auto primaryKeys = std::vector<IdType>{};
+    for (const auto& record : records) {
+        if (filter(record.first, record.second)) {
+            comboBox.addItem(record.second.name);
+            primaryKeys.push_back(record.first);
+        }
+    }
+
+    return primaryKeys;
+}
+
+template <class T, class IdType>
+std::vector<IdType> populateComboBox(Wt::WComboBox& comboBox, const std::map<IdType, T>& records) {
+    return populateComboBox(comboBox, records, [](IdType, const T&) { return true; });
+}
+
+void fillTableRow(Wt::WTable& table, int row, const TableRow& cells) {
+    for (auto column = 0; column < cells.size(); column++) {
+        table.elementAt(row, column)->addWidget(new Wt::WText(cells.cell(column)));
+    }
+}
+
+// only cells showing text are updated, those being edited are left alone
+void updateTableRow(Wt::WTable& table, int row, const TableRow& cells) {
+    for (auto column = 0; column < cells.size(); column++) {
+        auto text = dynamic_cast<Wt::WText*>(table.elementAt(row, column)->widget(0));
+        if (text)
+            text->setText(cells.cell(column));
+    }
+}
+
+// Query selects records in the database, filter is an optional check of loaded records which can't be expressed in SQL.
+// Mapper fills cells of the record's row by column keys of the schema, the row object is reused for all records.
 template <class T>
-void populateTable(Database& db, Wt::WTable& table, std::function<std::vector<std::pair<std::wstring, Wt::WString>>(const Wt::Dbo::ptr<T>& element, int row)> fieldLayoutMapper,
+void populateTable(Database& db, Wt::WTable& table, const TableSchema& schema, Wt::Dbo::Query<Wt::Dbo::ptr<T>> query,
+                   std::function<void(const Wt::Dbo::ptr<T>& element, TableRow& cells)> fieldMapper,
                    std::function<bool(const Wt::Dbo::ptr<T>& element)> filter = [](const Wt::Dbo::ptr<T>&) { return true; }) {
-    while (table.rowCount() != table.headerCount()) {
-        table.deleteRow(table.rowCount() - 1);
-    }
+    Tracing::Span span{"populateTable"};
+    table.clear();
+    schema.buildHeader(table);
 
     auto transaction = Wt::Dbo::Transaction{db};
-    auto records = Wt::Dbo::collection<Wt::Dbo::ptr<T>>{db.find<T>()};
-
-    if (table.headerCount() == 0)
-        table.setHeaderCount(1);
+    auto records = Wt::Dbo::collection<Wt::Dbo::ptr<T>>{query};
 
+    auto cells = TableRow{schema};
     auto row = table.headerCount();
     for (auto& record : records) {
         if (filter(record)) {
-            auto mapping = fieldLayoutMapper(record, row);
-            for (auto i = 0u; i < mapping.size(); i++) {
-                auto column = findColumn(table, mapping[i].first);
-                if (column == -1) {
-                    table.elementAt(0, table.columnCount())->addWidget(new Wt::WText(mapping[i].first));
-                    column = table.columnCount() - 1;
-                }
-
-                table.elementAt(row, column)->addWidget(new Wt::WText(std::move(mapping[i].second)));
-            }
+            cells.clear();
+            fieldMapper(record, cells);
+            fillTableRow(table, row, cells);
             row++;
         }
     }
 }
 
+// dialog with a message and OK button, deletes itself when closed
+void showMessageDialog(const Wt::WString& title, const Wt::WString& message) {
+    auto dialog = new Wt::WDialog(title);
+    auto okButton = new Wt::WPushButton("OK", dialog->footer());
+    okButton->clicked().connect(dialog, &Wt::WDialog::accept);
+    new Wt::WText(message, dialog->contents());
+
+    dialog->finished().connect(std::bind([dialog] { delete dialog; }));
+    dialog->show();
+}
+
 template <class T, class String>
 T* createLabeledField(String labelText, Wt::WContainerWidget* parent) {
     auto label = new Wt::WLabel(std::move(labelText), parent);
@@ -1,5 +1,11 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
 #include <functional>
 #include <memory>
+#include <string>
 #include <Wt/WServer>
 #include <Wt/WApplication>
 #include <Wt/WBootstrapTheme>
@@ -9,15 +15,33 @@
 #include <Wt/Auth/AuthWidget>
 #include <Wt/Auth/PasswordService>
 #include "database.h"
+#include "ConnectionPool.h"
+#include "Metrics.h"
+#include "MetricsResource.h"
+#include "SqlMetrics.h"
+#include "Tracing.h"
+#include "TraceResource.h"
+#include "RecipeExportResource.h"
+#include "PasswordLoginWidget.h"
+#include "PasswordHashing.h"
+#include "SessionResume.h"
+#include "Schema.h"
+#include "IngredientImport.h"
+#include "IngredientImportDialog.h"
 #include "User.h"
 #include "IngredientsWidget.h"
 #include "RecipesWidget.h"
 #include "UnitsWidget.h"
 
+namespace {
+std::atomic<int> liveSessions{0};
+}
+
 class App : public Wt::WApplication {
   public:
-    App(const Wt::WEnvironment& env) : WApplication(env) {
+    App(const Wt::WEnvironment& env, ConnectionPool& pool) : WApplication(env), db(pool) {
         Wt::log("notice") << "Creating new instance of App";
+        liveSessions++;
 
         setTitle(L"Cukiernia - System Przepisów");
         setTheme(new Wt::WBootstrapTheme(this));
@@ -26,19 +50,8 @@ class App : public Wt::WApplication {
         initDatabase();
         setupAuth();
 
-        menu->itemSelected().connect(std::bind([=]() {
-            if(!db.login.loggedIn()) {
-                return;
-            }
-
-            if (menu->currentIndex() == 0) {
-                recipes->populateRecipeList();
-            } else if (menu->currentIndex() == 1) {
-                ingredients->populateIngredientList();
-            } else if (menu->currentIndex() == 2) {
-                units->populateUnitsList();
-            }
-        }));
+        // widgets are kept up to date by FirmChanges, also with changes made in other sessions
+        enableUpdates(true);
 
         internalPathChanged().connect(std::bind([this] {
             Wt::log("notice") << "Internal path changed to: " << internalPath().c_str();
@@ -63,7 +76,7 @@ class App : public Wt::WApplication {
                 menu->select(-1);
                 content->setCurrentIndex(-1);
             } else if (internalPath() == "/wyloguj") {
-                db.login.logout();
+                SessionResume::logout(db);
             } else if (internalPath() == "/recipe") {
                 recipeDetails->setRecipe(recipes->currentRecipe);
                 content->setCurrentWidget(recipeDetails.get());
@@ -76,18 +89,25 @@ class App : public Wt::WApplication {
         internalPathChanged().emit(internalPath());
     }
 
+    ~App() override {
+        liveSessions--;
+        Wt::log("notice") << "Session made " << sqlTotals.statements << " SQL statements, taking "
+                          << std::chrono::duration_cast<std::chrono::milliseconds>(sqlTotals.time).count() << "ms";
+    }
+
+  protected:
+    // statements of every request are counted for the page it ends on, sampled requests are traced(event handling and rendering)
+    void notify(const Wt::WEvent& event) override {
+        Tracing::RequestScope trace;
+        Tracing::Span span{"App::notify"};
+        SqlMetrics::RequestScope request{sqlTotals};
+        WApplication::notify(event);
+        request.finish(internalPath());
+    }
+
   private:
     void initDatabase() {
-        db.mapClass<Ingredient>("ingredient");
-        db.mapClass<Unit>("unit");
-        db.mapClass<Recipe>("recipe");
-        db.mapClass<IngredientRecord>("ingredient_record");
-        db.mapClass<User>("user");
-        db.mapClass<AuthInfo>("auth_info");
-        db.mapClass<AuthInfo::AuthIdentityType>("auth_identity");
-        db.mapClass<AuthInfo::AuthTokenType>("auth_token");
-        db.ensureTablesExisting();
-
+        Schema::mapClasses(db);
         db.users = std::make_unique<UserDatabase>(db);
     }
 
@@ -105,19 +125,22 @@ class App : public Wt::WApplication {
     }
 
     void setupAuth() {
-        authWidget = std::make_unique<Wt::Auth::AuthWidget>(Database::auth(), *(db.users), db.login);
+        authWidget = std::make_unique<PasswordLoginWidget>(db);
         authWidget->model()->addPasswordAuth(&Database::passwordAuth());
-        authWidget->processEnvironment();
+        if (!SessionResume::fromCookie(db))
+            authWidget->processEnvironment();
 
         db.login.changed().connect(std::bind([this] {
+            db.refreshCurrentUser();
+
             for(auto* menuItem : menu->items()) {
                 menu->removeItem(menuItem);
             }
 
-            if(db.login.loggedIn() && db.users->find(db.login.user())->user().id() != -1) {
+            if(db.currentUser().loggedIn) {
                 Wt::Dbo::Transaction t{db};
 
-                Wt::log("notice") << db.users->find(db.login.user())->user().id() << " logged in!";
+                Wt::log("notice") << db.login.user().id() << " logged in!";
 
                 recipeDetails = std::make_unique<RecipeDetailsWidget>(content.get(), db);
                 recipes = std::make_unique<RecipesWidget>(content.get(), db);
@@ -164,27 +187,124 @@ class App : public Wt::WApplication {
     std::unique_ptr<Wt::WDialog> authDialog;
 
     Database db;
+    SqlMetrics::RequestScope::Totals sqlTotals;
 };
 
-Wt::WApplication* createApp(const Wt::WEnvironment& env) {
-    auto* app = new App(env);
+Wt::WApplication* createApp(const Wt::WEnvironment& env, ConnectionPool& pool) {
+    auto* app = new App(env, pool);
     app->messageResourceBundle().use("auth_strings");
     app->messageResourceBundle().use("auth_css_theme");
     return app;
 }
 
+// import without the web interface, e.g. of a file too large to upload; progress goes to stderr, the summary to stdout.
+// The running server doesn't know about it(its FirmCatalog is out of date), so it should be restarted afterwards.
+int importIngredients(ConnectionPool& pool, int firmID, const std::string& file) {
+    auto in = std::ifstream{file, std::ios::binary};
+    if (!in) {
+        std::cerr << "Cannot open " << file << std::endl;
+        return 1;
+    }
+
+    Database db{pool};
+    Schema::mapClasses(db);
+    auto result = IngredientImport::Result{};
+    auto committed = 0;
+    try {
+        result = IngredientImport{db, firmID}.run(in, [&committed](const IngredientImport::Result& done, std::uint64_t) {
+            committed = done.added + done.updated;
+            std::cerr << "\r" << committed << " rows imported" << std::flush;
+        });
+        std::cerr << std::endl;
+    } catch (const std::exception& e) {
+        // bad header as well as e.g. a lost connection, chunks committed before it stay
+        std::cerr << std::endl << "Import failed: " << e.what() << std::endl;
+        std::cerr << committed << " rows were committed before the failure" << std::endl;
+        if (committed > 0)
+            std::cerr << "Warning: a server running on this database doesn't see them until it's restarted" << std::endl;
+        return 1;
+    }
+
+    std::cout << result.added << " added, " << result.updated << " updated, " << result.skipped << " skipped" << std::endl;
+    for (const auto& error : result.errors) {
+        std::cout << error << std::endl;
+    }
+
+    if (result.added + result.updated > 0)
+        std::cerr << "Warning: a server running on this database doesn't see the imported ingredients until it's restarted" << std::endl;
+
+    return result.skipped > 0 ? 2 : 0;
+}
+
 int main(int argc, char** argv) {
+    // cukiernia.wt --import-ingredients <firm id> <file.csv> [options of the server, e.g. -c wt_config.xml] imports and exits
+    auto importFirm = 0;
+    auto importFile = std::string{};
+    if (argc >= 4 && std::string(argv[1]) == "--import-ingredients") {
+        try {
+            auto parsed = std::size_t{0};
+            importFirm = std::stoi(argv[2], &parsed);
+            if (argv[2][parsed] != '\0')
+                importFirm = 0;
+        } catch (const std::exception&) {
+        }
+
+        if (importFirm <= 0) {
+            std::cerr << "Invalid firm id: " << argv[2] << std::endl;
+            return 1;
+        }
+
+        importFile = argv[3];
+        argv[3] = argv[0];
+        argv += 3;
+        argc -= 3;
+    }
+
     try {
         Wt::WServer wSrv(argv[0]);
         wSrv.setServerConfiguration(argc, argv, WTHTTP_CONFIGURATION);
-        wSrv.addEntryPoint(Wt::Application, createApp);
 
-        Database::configureAuth();
+        auto pool = ConnectionPool::create(DatabaseConfig::fromServer(wSrv));
+        {
+            Database db{*pool};
+            Schema::mapClasses(db);
+            Schema::migrate(db);
+        }
+
+        if (!importFile.empty())
+            return importIngredients(*pool, importFirm, importFile);
+
+        wSrv.addEntryPoint(Wt::Application, [&pool](const Wt::WEnvironment& env) { return createApp(env, *pool); });
+
+        auto& metrics = Metrics::instance();
+        metrics.gauge("bakery_sessions_live", "Open sessions.", [] { return liveSessions.load(); });
+        metrics.gauge("bakery_db_pool_connections", "Connections in the pool.", [&pool] { return pool->usage().size; });
+        metrics.gauge("bakery_db_pool_connections_in_use", "Connections borrowed by transactions.", [&pool] { return pool->usage().inUse; });
+        metrics.gauge("bakery_db_pool_waiting_sessions", "Sessions waiting for a free connection.", [&pool] { return pool->usage().waiting; });
+        MetricsResource metricsResource;
+        wSrv.addResource(&metricsResource, "/metrics");
+
+        auto tracingConfig = TracingConfig::fromServer(wSrv);
+        Tracing::instance().configure(tracingConfig.sampleRate, tracingConfig.bufferEvents);
+        TraceResource traceResource{tracingConfig.token};
+        if (!tracingConfig.token.empty())
+            wSrv.addResource(&traceResource, "/admin/trace");
+
+        // recipes of any firm for scheduled jobs(e.g. nightly reports), not deployed without a token
+        auto exportToken = std::string{};
+        wSrv.readConfigurationProperty("export-token", exportToken);
+        RecipeExportResource exportResource{*pool, exportToken};
+        if (!exportToken.empty())
+            wSrv.addResource(&exportResource, "/export/recipes");
+
+        Database::configureAuth(AuthConfig::fromServer(wSrv));
 
         if(wSrv.start()) {
             Wt::WServer::waitForShutdown();
             wSrv.stop();
         }
+
+        IngredientImportThread::instance().stop();  // an import still running uses the pool
     } catch (Wt::WServer::Exception& e) {
         std::cerr << "WServer exception: " << e.what() << std::endl;
     } catch (Wt::Dbo::Exception& e) {
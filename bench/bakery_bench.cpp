@@ -0,0 +1,324 @@
+// Benchmarks of the data and rendering hot paths on a generated bakery, results are printed as JSON.
+// Runs against an in-memory SQLite database, so no MySQL server is needed:
+//
+//   ./bakery_bench --recipes 2000 --unit-depth 6 > bench.json
+//
+// Same seed gives the same dataset, so results of two builds can be compared.
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <Wt/WApplication>
+#include <Wt/WTable>
+#include <Wt/Test/WTestEnvironment>
+#include "ConnectionPool.h"
+#include "database.h"
+#include "Schema.h"
+#include "Unit.h"
+#include "UnitConversions.h"
+#include "FirmCatalog.h"
+#include "Ingredient.h"
+#include "Recipe.h"
+#include "References.h"
+#include "RecipeSummary.h"
+#include "RecipeTotals.h"
+#include "helpers.h"
+
+namespace {
+
+struct DatasetConfig {
+    unsigned seed = 42;
+    int firms = 3;
+    int units = 40;  // per firm
+    int unitDepth = 4;  // levels of the unit tree, roots included
+    int ingredients = 300;  // per firm
+    int recipes = 500;  // per firm
+    int records = 8;  // per recipe
+    int iterations = 20;  // of every benchmark
+};
+
+// ids of everything generated for a single firm
+struct Firm {
+    int id;
+    std::vector<Wt::Dbo::dbo_traits<Unit>::IdType> units;
+    std::vector<Wt::Dbo::dbo_traits<Ingredient>::IdType> ingredients;
+    std::vector<Wt::Dbo::dbo_traits<Recipe>::IdType> recipes;
+};
+
+struct Result {
+    std::string name;
+    int operations;  // per iteration
+    std::vector<double> nanoseconds;  // per operation, one for every iteration
+};
+
+bool readArgument(int argc, char** argv, int& i, const std::string& name, int& value) {
+    if (argv[i] != "--" + name || i + 1 >= argc) {
+        return false;
+    }
+
+    value = std::atoi(argv[++i]);
+    return true;
+}
+
+DatasetConfig parseArguments(int argc, char** argv) {
+    auto config = DatasetConfig{};
+    auto seed = static_cast<int>(config.seed);
+    for (auto i = 1; i < argc; i++) {
+        if (!readArgument(argc, argv, i, "seed", seed) && !readArgument(argc, argv, i, "firms", config.firms) &&
+            !readArgument(argc, argv, i, "units", config.units) && !readArgument(argc, argv, i, "unit-depth", config.unitDepth) &&
+            !readArgument(argc, argv, i, "ingredients", config.ingredients) && !readArgument(argc, argv, i, "recipes", config.recipes) &&
+            !readArgument(argc, argv, i, "records", config.records) && !readArgument(argc, argv, i, "iterations", config.iterations)) {
+            std::cerr << "bakery_bench: unknown argument " << argv[i] << std::endl;
+            std::exit(1);
+        }
+    }
+
+    config.seed = static_cast<unsigned>(seed);
+    config.unitDepth = std::max(config.unitDepth, 1);
+    config.units = std::max(config.units, config.unitDepth);
+    config.iterations = std::max(config.iterations, 1);
+    return config;
+}
+
+// unit i is on level i % unitDepth and is based on a random unit of the level above, the first unitDepth units make sure every level has one
+Firm generateFirm(Database& db, const DatasetConfig& config, int firmID, std::mt19937& random) {
+    auto firm = Firm{firmID};
+    auto levels = std::vector<std::vector<Wt::Dbo::dbo_traits<Unit>::IdType>>(config.unitDepth);
+    auto pick = [&random](const auto& ids) { return ids[std::uniform_int_distribution<std::size_t>(0, ids.size() - 1)(random)]; };
+    auto quantity = std::uniform_int_distribution<int>(2, 1000);
+
+    Wt::Dbo::Transaction transaction{db};
+    for (auto i = 0; i < config.units; i++) {
+        auto level = i % config.unitDepth;
+        auto unit = new Unit;
+        unit->name = "unit " + std::to_string(firmID) + "-" + std::to_string(i);
+        unit->quantity = level == 0 ? 1.0 : quantity(random);
+        unit->baseUnitID = level == 0 ? Wt::Dbo::dbo_traits<Unit>::invalidId() : pick(levels[level - 1]);
+        unit->ownerID = firmID;
+
+        auto added = db.add(unit);
+        db.flush();
+        levels[level].push_back(added.id());
+        firm.units.push_back(added.id());
+    }
+
+    auto value = std::uniform_real_distribution<double>(0.0, 100.0);
+    for (auto i = 0; i < config.ingredients; i++) {
+        auto ingredient = new Ingredient;
+        ingredient->name = "ingredient " + std::to_string(firmID) + "-" + std::to_string(i);
+        ingredient->price = value(random);
+        ingredient->kcal = static_cast<int>(value(random) * 9);
+        ingredient->fat = value(random);
+        ingredient->saturatedAcids = value(random);
+        ingredient->carbohydrates = value(random);
+        ingredient->sugar = value(random);
+        ingredient->protein = value(random);
+        ingredient->salt = value(random);
+        ingredient->unitID = pick(firm.units);
+        ingredient->ownerID = firmID;
+
+        auto added = db.add(ingredient);
+        db.flush();
+        firm.ingredients.push_back(added.id());
+    }
+
+    for (auto i = 0; i < config.recipes; i++) {
+        auto recipe = db.add(new Recipe);
+        recipe.modify()->name = "recipe " + std::to_string(firmID) + "-" + std::to_string(i);
+        recipe.modify()->ownerID = firmID;
+
+        for (auto j = 0; j < config.records; j++) {
+            auto record = db.add(new IngredientRecord);
+            record.modify()->ingredientID = pick(firm.ingredients);
+            record.modify()->unitID = pick(firm.units);
+            record.modify()->quantity = value(random);
+            record.modify()->recipe = recipe;
+        }
+
+        db.flush();
+        firm.recipes.push_back(recipe.id());
+    }
+
+    return firm;
+}
+
+// at most the first 100 ids, so that a benchmark takes about the same time for any dataset size
+template <class Id>
+std::vector<Id> sample(const std::vector<Id>& ids) {
+    return std::vector<Id>(ids.begin(), ids.begin() + std::min<std::size_t>(ids.size(), 100));
+}
+
+// body runs the given number of operations, iterations are timed separately
+Result measure(const std::string& name, const DatasetConfig& config, int operations, std::function<void()> body) {
+    auto result = Result{name, operations};
+    body();  // warm up caches(session, catalog, SQLite pages), they are warm in a running server too
+
+    for (auto i = 0; i < config.iterations; i++) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        result.nanoseconds.push_back(elapsed / std::max(operations, 1));
+    }
+
+    return result;
+}
+
+void printJson(const DatasetConfig& config, const std::vector<Result>& results) {
+    std::cout << "{\n  \"dataset\": {\"seed\": " << config.seed << ", \"firms\": " << config.firms << ", \"units\": " << config.units
+              << ", \"unit_depth\": " << config.unitDepth << ", \"ingredients\": " << config.ingredients << ", \"recipes\": " << config.recipes
+              << ", \"records\": " << config.records << ", \"iterations\": " << config.iterations << "},\n  \"benchmarks\": [\n";
+
+    for (auto i = 0u; i < results.size(); i++) {
+        auto sorted = results[i].nanoseconds;
+        std::sort(sorted.begin(), sorted.end());
+        auto mean = 0.0;
+        for (auto value : sorted) {
+            mean += value / sorted.size();
+        }
+
+        std::cout << "    {\"name\": \"" << results[i].name << "\", \"operations\": " << results[i].operations << ", \"min_ns\": " << sorted.front()
+                  << ", \"median_ns\": " << sorted[sorted.size() / 2] << ", \"mean_ns\": " << mean << ", \"max_ns\": " << sorted.back() << "}"
+                  << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    std::cout << "  ]\n}" << std::endl;
+}
+
+enum IngredientColumn { colName, colPrice, colKcal, colUnit };
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    auto config = parseArguments(argc, argv);
+
+    auto databaseConfig = DatabaseConfig{};
+    databaseConfig.dialect = SqlDialect{SqlDialect::Backend::SQLite};
+    databaseConfig.path = ":memory:";
+    databaseConfig.poolSize = 1;
+    auto pool = ConnectionPool::create(databaseConfig);
+    Database db{*pool};
+    Schema::mapClasses(db);
+    Schema::migrate(db);  // same tables and indexes as the server
+
+    auto random = std::mt19937{config.seed};
+    auto firms = std::vector<Firm>{};
+    for (auto firmID = 1; firmID <= config.firms; firmID++) {
+        firms.push_back(generateFirm(db, config, firmID, random));
+    }
+    RecipeTotals::rebuild(db);
+
+    // the first firm is measured, the others only make the tables realistic
+    const auto& firm = firms.front();
+    auto recipes = sample(firm.recipes);
+    auto ingredients = sample(firm.ingredients);
+    auto units = sample(firm.units);
+
+    auto results = std::vector<Result>{};
+
+    results.push_back(measure("recipe_totals", config, static_cast<int>(recipes.size()), [&] {
+        Wt::Dbo::Transaction transaction{db};
+        for (auto id : recipes) {
+            Wt::Dbo::ptr<Recipe> recipe = db.find<Recipe>().where("id = ?").bind(id);
+            recipe->totals(db);
+        }
+    }));
+
+    // records are loaded once, only the scaling by the catalog is measured
+    auto records = std::vector<Wt::Dbo::ptr<IngredientRecord>>{};
+    {
+        Wt::Dbo::Transaction transaction{db};
+        for (auto id : recipes) {
+            Wt::Dbo::collection<Wt::Dbo::ptr<IngredientRecord>> recipeRecords = db.find<IngredientRecord>().where("recipe_id = ?").bind(id);
+            records.insert(records.end(), recipeRecords.begin(), recipeRecords.end());
+        }
+    }
+
+    results.push_back(measure("ingredient_record_scaled", config, static_cast<int>(records.size()), [&] {
+        auto catalog = FirmCatalog::instance().snapshot(db, firm.id);
+        for (const auto& record : records) {
+            record->scaled(*catalog);
+        }
+    }));
+
+    auto unitRows = std::vector<UnitConversions::UnitRow>{};
+    for (const auto& unit : FirmCatalog::instance().snapshot(db, firm.id)->units) {
+        unitRows.push_back({unit.first, unit.second.baseUnitID, unit.second.quantity});
+    }
+
+    results.push_back(measure("unit_conversions_build", config, 1, [&] {
+        UnitConversions{unitRows};
+    }));
+
+    // what the first session of a firm(or the first one after an import) pays
+    results.push_back(measure("firm_catalog_load", config, 1, [&] {
+        FirmCatalog::instance().invalidate(firm.id);
+        FirmCatalog::instance().snapshot(db, firm.id);
+    }));
+
+    results.push_back(measure("recipe_totals_recipe_changed", config, static_cast<int>(recipes.size()), [&] {
+        Wt::Dbo::Transaction transaction{db};
+        for (auto id : recipes) {
+            RecipeTotals::recipeChanged(db, firm.id, id);
+        }
+    }));
+
+    // a root unit, so that every recipe with records in its tree is computed again
+    results.push_back(measure("recipe_totals_unit_changed", config, 1, [&] {
+        Wt::Dbo::Transaction transaction{db};
+        RecipeTotals::unitChanged(db, firm.id, firm.units.front(), FirmCatalog::instance().snapshot(db, firm.id)->conversions);
+    }));
+
+    results.push_back(measure("recipe_summary_page", config, 1, [&] {
+        RecipeSummary::load(db, firm.id, boost::none, "total_price desc", 0, 50);
+    }));
+
+    results.push_back(measure("references_recipes_using_ingredient", config, static_cast<int>(ingredients.size()), [&] {
+        for (auto id : ingredients) {
+            References::recipesUsingIngredient(db, id);
+        }
+    }));
+
+    results.push_back(measure("references_recipes_using_unit", config, static_cast<int>(units.size()), [&] {
+        for (auto id : units) {
+            References::recipesUsingUnit(db, id);
+        }
+    }));
+
+    results.push_back(measure("references_ingredients_using_unit", config, static_cast<int>(units.size()), [&] {
+        for (auto id : units) {
+            References::ingredientsUsingUnit(db, id);
+        }
+    }));
+
+    results.push_back(measure("references_units_based_on", config, static_cast<int>(units.size()), [&] {
+        for (auto id : units) {
+            References::unitsBasedOn(db, id);
+        }
+    }));
+
+    // rendering needs an application, which needs an environment
+    {
+        Wt::Test::WTestEnvironment environment;
+        Wt::WApplication application(environment);
+        auto table = new Wt::WTable(application.root());
+
+        auto schema = TableSchema{{{colName, L"Nazwa"}, {colPrice, L"Cena"}, {colKcal, L"Kaloryczność"}, {colUnit, L"Jednostka"}}};
+        auto catalog = FirmCatalog::instance().snapshot(db, firm.id);
+        results.push_back(measure("populate_table_ingredients", config, config.ingredients, [&] {
+            populateTable<Ingredient>(db, *table, schema, ownedBy<Ingredient>(db, firm.id), [&catalog](const Wt::Dbo::ptr<Ingredient>& ingredient, TableRow& cells) {
+                auto unit = catalog->unit(ingredient->unitID);
+                cells.set(colName, ingredient->name);
+                cells.set(colPrice, std::to_string(ingredient->price));
+                cells.set(colKcal, std::to_string(ingredient->kcal));
+                cells.set(colUnit, unit ? unit->name : Wt::WString::Empty);
+            });
+        }));
+    }
+
+    printJson(config, results);
+    return 0;
+}
@@ -0,0 +1,122 @@
+-- Query plans of the hot lookups before and after the secondary indexes of schema version 2.
+-- Works on its own scratch database, tables mirror what Wt::Dbo creates for the mapped classes.
+--
+--   mysql -u root -p < bench/index_plans.sql > index_plans.txt
+--
+-- Data: 200 firms, 20 units, 150 ingredients and 250 recipes per firm, 1 000 000 ingredient records.
+
+DROP DATABASE IF EXISTS cukiernia_index_bench;
+CREATE DATABASE cukiernia_index_bench;
+USE cukiernia_index_bench;
+
+CREATE TABLE unit (
+    id BIGINT AUTO_INCREMENT PRIMARY KEY,
+    version INTEGER NOT NULL,
+    name TEXT NOT NULL,
+    base_unit_id BIGINT NOT NULL,
+    quantity DOUBLE PRECISION NOT NULL,
+    owner_id INTEGER NOT NULL
+) ENGINE = InnoDB;
+
+CREATE TABLE ingredient (
+    id BIGINT AUTO_INCREMENT PRIMARY KEY,
+    version INTEGER NOT NULL,
+    name TEXT NOT NULL,
+    price DOUBLE PRECISION NOT NULL,
+    kcal INTEGER NOT NULL,
+    fat DOUBLE PRECISION NOT NULL,
+    saturated_acids DOUBLE PRECISION NOT NULL,
+    carbohydrates DOUBLE PRECISION NOT NULL,
+    sugar DOUBLE PRECISION NOT NULL,
+    protein DOUBLE PRECISION NOT NULL,
+    salt DOUBLE PRECISION NOT NULL,
+    unit_id BIGINT NOT NULL,
+    owner_id INTEGER NOT NULL
+) ENGINE = InnoDB;
+
+CREATE TABLE recipe (
+    id BIGINT AUTO_INCREMENT PRIMARY KEY,
+    version INTEGER NOT NULL,
+    name TEXT NOT NULL,
+    owner_id INTEGER NOT NULL
+) ENGINE = InnoDB;
+
+-- Dbo declares a foreign key for belongsTo(), InnoDB backs it with an index of its own
+CREATE TABLE ingredient_record (
+    id BIGINT AUTO_INCREMENT PRIMARY KEY,
+    version INTEGER NOT NULL,
+    quantity DOUBLE PRECISION NOT NULL,
+    unit_id BIGINT NOT NULL,
+    ingredient_id BIGINT NOT NULL,
+    recipe_id BIGINT,
+    CONSTRAINT fk_ingredient_record_recipe FOREIGN KEY (recipe_id) REFERENCES recipe (id)
+) ENGINE = InnoDB;
+
+CREATE TABLE digit (d INTEGER NOT NULL);
+INSERT INTO digit VALUES (0), (1), (2), (3), (4), (5), (6), (7), (8), (9);
+
+CREATE TABLE seq (n INTEGER NOT NULL PRIMARY KEY);
+INSERT INTO seq
+SELECT a.d + 10 * b.d + 100 * c.d + 1000 * d.d + 10000 * e.d + 100000 * f.d
+FROM digit a, digit b, digit c, digit d, digit e, digit f;
+
+-- per firm: unit 1 is the root, every other unit is based on the previous one
+INSERT INTO unit (id, version, name, base_unit_id, quantity, owner_id)
+SELECT n + 1, 0, CONCAT('unit ', n), IF(n % 20 = 0, -1, n), 10, n DIV 20
+FROM seq WHERE n < 200 * 20;
+
+INSERT INTO ingredient (id, version, name, price, kcal, fat, saturated_acids, carbohydrates, sugar, protein, salt, unit_id, owner_id)
+SELECT n + 1, 0, CONCAT('ingredient ', n), 1.5, 100, 1, 1, 1, 1, 1, 1, (n DIV 150) * 20 + n % 20 + 1, n DIV 150
+FROM seq WHERE n < 200 * 150;
+
+INSERT INTO recipe (id, version, name, owner_id)
+SELECT n + 1, 0, CONCAT('recipe ', n), n DIV 250
+FROM seq WHERE n < 200 * 250;
+
+-- 20 records per recipe, ingredients and units from the recipe's firm
+INSERT INTO ingredient_record (version, quantity, unit_id, ingredient_id, recipe_id)
+SELECT 0, 2, (r DIV 250) * 20 + n % 20 + 1, (r DIV 250) * 150 + (n * 7) % 150 + 1, r + 1
+FROM (SELECT n, n DIV 20 AS r FROM seq) s;
+
+ANALYZE TABLE unit, ingredient, recipe, ingredient_record;
+
+DELIMITER //
+CREATE PROCEDURE explain_hot_queries()
+BEGIN
+    -- listings of one firm; the name prefix only narrows the rows, sorting stays a filesort
+    EXPLAIN SELECT id, name FROM recipe WHERE owner_id = 17 ORDER BY name;
+    EXPLAIN SELECT id, name FROM ingredient WHERE owner_id = 17 ORDER BY name;
+    EXPLAIN SELECT id, name FROM unit WHERE owner_id = 17 ORDER BY name;
+    -- records of a recipe
+    EXPLAIN SELECT * FROM ingredient_record WHERE recipe_id = 4242;
+    -- "is it used" checks before delete
+    EXPLAIN SELECT 1 FROM ingredient_record WHERE ingredient_id = 2600 LIMIT 1;
+    EXPLAIN SELECT 1 FROM ingredient_record WHERE unit_id = 341 LIMIT 1;
+    EXPLAIN SELECT 1 FROM ingredient WHERE unit_id = 341 LIMIT 1;
+    EXPLAIN SELECT 1 FROM unit WHERE base_unit_id = 341 LIMIT 1;
+    -- recipe list aggregation of one firm
+    EXPLAIN SELECT r.id, SUM(i.price * ir.quantity)
+            FROM recipe r
+            LEFT JOIN ingredient_record ir ON ir.recipe_id = r.id
+            LEFT JOIN ingredient i ON i.id = ir.ingredient_id
+            WHERE r.owner_id = 17 GROUP BY r.id;
+END //
+DELIMITER ;
+
+SELECT 'before indexes' AS plans;
+CALL explain_hot_queries();
+
+-- same statements as migration 2 in Schema.h on MySQL; recipe_id keeps the index InnoDB made for its foreign key
+CREATE INDEX unit_owner_name ON unit (owner_id, name(64));
+CREATE INDEX unit_base_unit ON unit (base_unit_id);
+CREATE INDEX ingredient_owner_name ON ingredient (owner_id, name(64));
+CREATE INDEX ingredient_unit ON ingredient (unit_id);
+CREATE INDEX recipe_owner_name ON recipe (owner_id, name(64));
+CREATE INDEX ingredient_record_ingredient ON ingredient_record (ingredient_id);
+CREATE INDEX ingredient_record_unit ON ingredient_record (unit_id);
+ANALYZE TABLE unit, ingredient, recipe, ingredient_record;
+
+SELECT 'after indexes' AS plans;
+CALL explain_hot_queries();
+
+DROP DATABASE cukiernia_index_bench;